@@ -8,6 +8,7 @@
 #include "threads/io.h"
 #include "threads/thread.h"
 #include "threads/init.h"
+#include "threads/slab.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
 #ifdef USERPROG
@@ -15,6 +16,7 @@
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #endif
 
@@ -125,8 +127,10 @@ void shutdown_power_off(void) {
 static void print_stats(void) {
   timer_print_stats();
   thread_print_stats();
+  slab_print_stats();
 #ifdef FILESYS
   block_print_stats();
+  cache_print_stats();
 #endif
   console_print_stats();
 //   kbd_print_stats();
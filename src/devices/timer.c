@@ -1,12 +1,16 @@
 #include "devices/timer.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stdio.h>
 #include <riscv.h>
+#include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/io.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "userprog/pagedir.h"
 
 /* See [riscv-priviledged-20211203] 3.2 for hardware details of RISC-V timer. */
 
@@ -53,8 +57,55 @@ static void timer_interrupt_machine(struct intr_frame* args UNUSED) {
 
 #else
 
+/* Threads blocked in timer_sleep(), hashed by wake-up tick into a
+   timing wheel of SLEEP_WHEEL_SIZE slots.  Each slot is kept
+   sorted by wake-up tick, so a timer interrupt only examines the
+   threads it wakes plus at most one that stays asleep.
+   Access with interrupts off. */
+#define SLEEP_WHEEL_SIZE 64 /* Power of 2. */
+static struct list sleep_wheel[SLEEP_WHEEL_SIZE];
+
+static list_less_func wakeup_less;
+static void wake_sleepers(void);
+
+/* -tickless: Suppress periodic ticks while the CPU is idle? */
+bool timer_tickless;
+
+/* Kernel virtual address of the CLINT.  Mapped only in tickless
+   mode, where Supervisor reprograms mtimecmp itself. */
+static uintptr_t clint;
+
+/* Tickless idle state.  While TICK_STOPPED is true, the periodic
+   tick due at mtime TICK_RESUME_TIME, and every TIMER_INTERVAL
+   after it, has been suppressed and not yet accounted for. */
+static bool tick_stopped;
+static uint64_t tick_resume_time;
+
+/* Longest the CPU may idle without a tick, in ticks.  Bounds how
+   far mtimecmp is pushed when no thread is sleeping. */
+#define TICKLESS_MAX_IDLE TIMER_FREQ
+
+static int64_t next_wakeup_tick(void);
+static uint64_t clint_read64(uintptr_t reg);
+static void clint_write_mtimecmp(uint64_t value);
+static void timer_resume_tick(void);
+
+/* Returns the sleep wheel slot for threads waking at TICK. */
+static inline struct list* sleep_slot(int64_t tick) {
+  return &sleep_wheel[(size_t)tick & (SLEEP_WHEEL_SIZE - 1)];
+}
+
 /* Registers the corresponding Supervisor interrupt. */
 void timer_init(void) {
+  size_t i;
+
+  for (i = 0; i < SLEEP_WHEEL_SIZE; i++)
+    list_init(&sleep_wheel[i]);
+
+  /* Tickless mode needs to reach mtime and mtimecmp. */
+  if (timer_tickless)
+    clint = (uintptr_t)pagedir_set_mmio(init_page_dir, (void*)CLINT, 0x10000, true);
+
   intr_register_int(IRQ_S_SOFTWARE, false, INTR_ON, timer_interrupt, "Supervisor Timer");
 
   /* Enables Supervisor timer interrupt. */
@@ -98,13 +149,23 @@ int64_t timer_ticks(void) {
 int64_t timer_elapsed(int64_t then) { return timer_ticks() - then; }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.
+
+   The thread is blocked on the sleep wheel until timer_interrupt()
+   sees its wake-up tick, instead of being rescheduled every tick. */
 void timer_sleep(int64_t ticks) {
-  int64_t start = timer_ticks();
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
 
   ASSERT(intr_get_level() == INTR_ON);
-  while (timer_elapsed(start) < ticks)
-    thread_yield();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable();
+  cur->wakeup_tick = timer_ticks() + ticks;
+  list_insert_ordered(sleep_slot(cur->wakeup_tick), &cur->elem, wakeup_less, NULL);
+  thread_block();
+  intr_set_level(old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -149,10 +210,52 @@ void timer_ndelay(int64_t ns) { real_time_delay(ns, 1000 * 1000 * 1000); }
 /* Prints timer statistics. */
 void timer_print_stats(void) { printf("Timer: %" PRId64 " ticks\n", timer_ticks()); }
 
+/* Called by the idle thread, with interrupts off, just before it
+   waits for an interrupt.  In tickless mode, if the ready queue is
+   empty, pushes the next timer interrupt out to the earliest
+   sleeping thread's wake-up tick (capped at TICKLESS_MAX_IDLE
+   ticks) so that an idle CPU is not woken every tick for
+   nothing. */
+void timer_tickless_enter(void) {
+  uint64_t cmp;
+  int64_t idle_ticks;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  if (!timer_tickless || tick_stopped || threads_ready())
+    return;
+
+  idle_ticks = next_wakeup_tick() - ticks;
+  if (idle_ticks > TICKLESS_MAX_IDLE)
+    idle_ticks = TICKLESS_MAX_IDLE;
+  if (idle_ticks <= 1)
+    return;
+
+  /* Machine mode keeps mtimecmp one interval ahead of the last
+     tick it delivered, so that is the next tick due. */
+  cmp = clint_read64(CLINT_MTIMECMP);
+  tick_resume_time = cmp;
+  tick_stopped = true;
+  clint_write_mtimecmp(cmp + (idle_ticks - 1) * TIMER_INTERVAL);
+}
+
+/* Called by the idle thread, with interrupts off, after it was
+   woken up.  Restarts the periodic tick if it was stopped. */
+void timer_tickless_exit(void) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  if (tick_stopped)
+    timer_resume_tick();
+}
+
 /* Supervisor timer interrupt handler. */
 static void timer_interrupt(struct intr_frame* args UNUSED) {
-  ticks++;
-  thread_tick();
+  if (tick_stopped) {
+    /* The tick we programmed in timer_tickless_enter() fired. */
+    timer_resume_tick();
+  } else {
+    ticks++;
+    wake_sleepers();
+    thread_tick();
+  }
 
   /* When bit i in sip is writable, a pending interrupt i can be cleared
      by writing 0 to this bit.  Wrting to IRQ_S_TIMER is ignored,
@@ -160,6 +263,103 @@ static void timer_interrupt(struct intr_frame* args UNUSED) {
   csr_write(CSR_SIP, csr_read(CSR_SIP) & ~(1 << IRQ_S_SOFTWARE));
 }
 
+/* Orders threads on a sleep wheel slot by wake-up tick. */
+static bool wakeup_less(const struct list_elem* a_, const struct list_elem* b_,
+                        void* aux UNUSED) {
+  const struct thread* a = list_entry(a_, struct thread, elem);
+  const struct thread* b = list_entry(b_, struct thread, elem);
+
+  return a->wakeup_tick < b->wakeup_tick;
+}
+
+/* Unblocks every sleeping thread whose wake-up tick has arrived.
+   Only the current tick's slot can hold such threads; the rest of
+   that slot belongs to later revolutions of the wheel. */
+static void wake_sleepers(void) {
+  struct list* slot = sleep_slot(ticks);
+
+  while (!list_empty(slot)) {
+    struct thread* t = list_entry(list_front(slot), struct thread, elem);
+    if (t->wakeup_tick > ticks)
+      break;
+
+    list_pop_front(slot);
+    thread_unblock(t);
+    if (active_sched_policy == SCHED_PRIO && t->priority > thread_current()->priority)
+      intr_yield_on_return();
+  }
+}
+
+/* Returns the earliest wake-up tick of any sleeping thread, or
+   INT64_MAX if no thread is sleeping. */
+static int64_t next_wakeup_tick(void) {
+  int64_t next = INT64_MAX;
+  size_t i;
+
+  for (i = 0; i < SLEEP_WHEEL_SIZE; i++)
+    if (!list_empty(&sleep_wheel[i])) {
+      struct thread* t = list_entry(list_front(&sleep_wheel[i]), struct thread, elem);
+      if (t->wakeup_tick < next)
+        next = t->wakeup_tick;
+    }
+  return next;
+}
+
+/* Reads the 64-bit CLINT register at physical address REG.
+   On RV32 the high word is re-read to catch a carry between the
+   two halves. */
+static uint64_t clint_read64(uintptr_t reg) {
+  volatile uint32_t* p = (volatile uint32_t*)(clint + (reg - CLINT));
+  uint32_t hi, lo;
+
+  do {
+    hi = inl(p + 1);
+    lo = inl(p);
+  } while (hi != inl(p + 1));
+  return (uint64_t)hi << 32 | lo;
+}
+
+/* Sets mtimecmp to VALUE.  The low word is first set to its
+   maximum so that no intermediate value can raise a spurious
+   interrupt.  See [riscv-priviledged-20211203] 3.2.1 "Machine
+   Timer Registers (mtime and mtimecmp)". */
+static void clint_write_mtimecmp(uint64_t value) {
+  volatile uint32_t* p = (volatile uint32_t*)(clint + (CLINT_MTIMECMP - CLINT));
+
+  outl(p, UINT32_MAX);
+  outl(p + 1, value >> 32);
+  outl(p, (uint32_t)value);
+}
+
+/* Leaves tickless idle.  Accounts for every periodic tick that
+   was due while the tick was stopped, wakes the threads whose
+   deadline passed meanwhile, and reprograms mtimecmp to the next
+   periodic tick. */
+static void timer_resume_tick(void) {
+  uint64_t now;
+  int64_t missed, i;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(tick_stopped);
+
+  /* Any pending tick is accounted for below. */
+  csr_write(CSR_SIP, csr_read(CSR_SIP) & ~(1 << IRQ_S_SOFTWARE));
+
+  now = clint_read64(CLINT_MTIME);
+  missed = now >= tick_resume_time ? (now - tick_resume_time) / TIMER_INTERVAL + 1 : 0;
+  clint_write_mtimecmp(tick_resume_time + missed * TIMER_INTERVAL);
+  tick_stopped = false;
+
+  /* Catch up.  The wheel has only SLEEP_WHEEL_SIZE slots, so
+     visiting that many consecutive ticks covers every slot. */
+  for (i = 0; i < missed; i++) {
+    ticks++;
+    if (missed - i <= SLEEP_WHEEL_SIZE)
+      wake_sleepers();
+  }
+  thread_tick_idle(missed);
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool too_many_loops(unsigned loops) {
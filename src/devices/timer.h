@@ -2,6 +2,7 @@
 #define DEVICES_TIMER_H
 
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #define CLINT 0x2000000L
@@ -15,7 +16,10 @@
 #define QEMU_FREQ 0x989680
 
 /* 50ms. */
-#define TIMER_INTERVAL QEMU_FREQ / TIMER_FREQ  // TODO: change to some other approaches
+#define TIMER_INTERVAL (QEMU_FREQ / TIMER_FREQ)  // TODO: change to some other approaches
+
+/* -tickless: Suppress periodic ticks while the CPU is idle? */
+extern bool timer_tickless;
 
 void timer_init(void);
 void timer_init_machine(void);
@@ -35,6 +39,10 @@ void timer_mdelay(int64_t milliseconds);
 void timer_udelay(int64_t microseconds);
 void timer_ndelay(int64_t nanoseconds);
 
+/* Tickless idle. */
+void timer_tickless_enter(void);
+void timer_tickless_exit(void);
+
 void timer_print_stats(void);
 
 #endif /* devices/timer.h */
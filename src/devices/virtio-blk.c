@@ -464,18 +464,28 @@ static void virtqueue_setup(struct virtio_blk* blk) {
    If WRITE is true, writes sector SEC_NO to disk D from BUFFER,
    which must contain BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+   per-disk locking is unneeded.
+
+   The device transfers directly to or from BUFFER if it lies in
+   the kernel's mapping of physical memory, which is contiguous.
+   Any other buffer is copied through LOCAL_BUFFER, in the
+   direction of the transfer only. */
 static void virtio_blk_rw(struct virtio_blk* d, block_sector_t sec_no, void* buffer, bool write) {
   struct virtio_blk_req* req;
   uint16_t desc_idx, head;
   uint32_t id;
   uint8_t local_buffer[BLOCK_SECTOR_SIZE];
+  uint8_t* dma_buffer;
 
   #ifndef MACHINE
   lock_acquire(&d->lock);
+  dma_buffer = is_kernel_vaddr(buffer) ? buffer : local_buffer;
+  #else
+  dma_buffer = buffer;
   #endif
 
-  memcpy((void*) local_buffer, buffer, BLOCK_SECTOR_SIZE);
+  if (dma_buffer != buffer && write)
+    memcpy((void*) local_buffer, buffer, BLOCK_SECTOR_SIZE);
 
   /* In our design, we always allocate 3 */
   head = desc_idx = d->next_desc_idx;
@@ -503,7 +513,7 @@ static void virtio_blk_rw(struct virtio_blk* d, block_sector_t sec_no, void* buf
             VIRTQ_DESC_F_NEXT, desc_idx = (desc_idx + 1) % QUEUE_SIZE);
   
   /* Our request body. */
-  write_desc(&d->desc[desc_idx], ((uintptr_t) local_buffer) & SIZE_MAX, BLOCK_SECTOR_SIZE,
+  write_desc(&d->desc[desc_idx], ((uintptr_t) dma_buffer) & SIZE_MAX, BLOCK_SECTOR_SIZE,
             VIRTQ_DESC_F_NEXT | (write ? 0 : VIRTQ_DESC_F_WRITE),
             desc_idx = (desc_idx + 1) % QUEUE_SIZE);
   
@@ -554,7 +564,8 @@ static void virtio_blk_rw(struct virtio_blk* d, block_sector_t sec_no, void* buf
   recycle_desc(d, id);
   ++d->last_seen_used;
 
-  memcpy(buffer, (void*) local_buffer, BLOCK_SECTOR_SIZE);
+  if (dma_buffer != buffer && !write)
+    memcpy(buffer, (void*) local_buffer, BLOCK_SECTOR_SIZE);
 
   #ifndef MACHINE
   lock_release(&d->lock);
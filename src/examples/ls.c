@@ -12,6 +12,30 @@
 #include <stdio.h>
 #include <string.h>
 
+static void list_entry(const char* dir, const struct dirent* entry, bool verbose) {
+  printf("%s", entry->name);
+  if (verbose) {
+    char full_name[128];
+    int entry_fd;
+
+    snprintf(full_name, sizeof full_name, "%s/%s", dir, entry->name);
+    entry_fd = open(full_name);
+
+    printf(": ");
+    if (entry_fd != -1) {
+      bool is_dir = entry->type == DT_UNKNOWN ? isdir(entry_fd) : entry->type == DT_DIR;
+      if (is_dir)
+        printf("directory");
+      else
+        printf("%d-byte file", filesize(entry_fd));
+      printf(", inumber %d", entry->inumber);
+    } else
+      printf("open failed");
+    close(entry_fd);
+  }
+  printf("\n");
+}
+
 static bool list_dir(const char* dir, bool verbose) {
   int dir_fd = open(dir);
   if (dir_fd == -1) {
@@ -20,35 +44,19 @@ static bool list_dir(const char* dir, bool verbose) {
   }
 
   if (isdir(dir_fd)) {
-    char name[READDIR_MAX_LEN];
+    /* Entries are read in batches, so that even a large directory
+       takes only a few system calls to list. */
+    struct dirent entries[32];
+    int cnt, i;
 
     printf("%s", dir);
     if (verbose)
       printf(" (inumber %d)", inumber(dir_fd));
     printf(":\n");
 
-    while (readdir(dir_fd, name)) {
-      printf("%s", name);
-      if (verbose) {
-        char full_name[128];
-        int entry_fd;
-
-        snprintf(full_name, sizeof full_name, "%s/%s", dir, name);
-        entry_fd = open(full_name);
-
-        printf(": ");
-        if (entry_fd != -1) {
-          if (isdir(entry_fd))
-            printf("directory");
-          else
-            printf("%d-byte file", filesize(entry_fd));
-          printf(", inumber %d", inumber(entry_fd));
-        } else
-          printf("open failed");
-        close(entry_fd);
-      }
-      printf("\n");
-    }
+    while ((cnt = getdents(dir_fd, entries, sizeof entries / sizeof *entries)) > 0)
+      for (i = 0; i < cnt; i++)
+        list_entry(dir, &entries[i], verbose);
   } else
     printf("%s: not a directory\n", dir);
   close(dir_fd);
@@ -0,0 +1,485 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+/* Buffer cache.
+
+   Keeps up to CACHE_SIZE sectors of the file system device in
+   memory, so that reading the same sector again does not go to
+   the device, and writes are collected in memory until the
+   sector is evicted or the cache is flushed.
+
+   cache_lock protects the mapping from sectors to entries: each
+   entry's sector, valid flag, pin count, and accessed bit, plus
+   the clock hand.  Each entry's own lock protects its data and
+   dirty flag and is held across device I/O on the entry, so
+   other entries remain usable meanwhile.  An entry cannot be
+   evicted while it is pinned.
+
+   Replacement uses the clock algorithm.  A dirty victim is handed
+   to its new sector at once and written back after cache_lock is
+   released, holding only the victim's lock, so that lookups of
+   other sectors do not wait for the write.  Until the write is
+   done, the entry is marked as evicting its old sector, and
+   lookups of the old sector wait, so that nobody reads that
+   sector from the device before its latest contents are there.
+
+   cache_read_sector() reads a whole sector that is not cached
+   straight from the device into the caller's buffer, without
+   caching it, so that its data is not copied at all.  Only reads
+   larger than the cache use it, so that smaller ones, such as
+   loading an executable, leave their sectors cached for next
+   time.
+
+   A background thread reads sectors queued by cache_read_ahead()
+   into the cache, so that a sequential reader finds the next
+   sectors already there.
+
+   Writes only dirty the cache.  Another background thread, the
+   flusher, writes dirty sectors back FLUSH_INTERVAL ticks after
+   the cache first becomes dirty, or sooner once more than
+   DIRTY_HIGH sectors are dirty, so that writers rarely have to
+   wait for write-back on eviction.  While nothing is dirty, it
+   stays blocked instead of polling.  It
+   first has the free map write its changed sectors into the
+   cache and commits the running journal transaction, so that
+   they go to disk along with everything else.
+
+   A sector written inside a journal handle joins the running
+   transaction and is marked journaled.  A journaled entry is
+   neither written back nor evicted until the transaction has been
+   committed to the journal and journal_commit() clears the mark
+   with cache_unjournal(). */
+
+/* A cached sector. */
+struct cache_entry {
+  /* Protected by cache_lock. */
+  block_sector_t sector;  /* Sector cached here, if in_use. */
+  bool in_use;            /* Assigned to a sector? */
+  bool accessed;          /* Used since the clock hand last passed? */
+  int pin_cnt;            /* Number of users; not evictable if > 0. */
+  bool evicting;          /* Writing back EVICTED? */
+  block_sector_t evicted; /* Sector previously cached here. */
+
+  /* Protected by lock. */
+  struct lock lock; /* Held while using or doing I/O on data. */
+  bool valid;       /* Does data hold the sector's contents? */
+  bool dirty;       /* Does data need to be written back? */
+  bool journaled;   /* In the running transaction?  Changes only while pinned. */
+  uint8_t* data;    /* BLOCK_SECTOR_SIZE bytes of sector data. */
+};
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;
+static struct condition cache_unpinned; /* Signaled when an entry is unpinned. */
+static struct condition eviction_done;  /* Signaled when a write-back for eviction ends. */
+static size_t clock_hand;
+
+/* Statistics, protected by cache_lock. */
+static long long hit_cnt;    /* Lookups that found the sector cached. */
+static long long miss_cnt;   /* Lookups that had to take an entry. */
+static long long direct_cnt; /* Sectors read around the cache. */
+
+/* Read-ahead queue, a ring buffer of sectors protected by
+   read_ahead_lock.  Requests that do not fit are dropped. */
+#define READ_AHEAD_QUEUE_SIZE 32
+static block_sector_t read_ahead_queue[READ_AHEAD_QUEUE_SIZE];
+static size_t read_ahead_head, read_ahead_cnt;
+static struct lock read_ahead_lock;
+static struct condition read_ahead_ready;
+
+static thread_func read_ahead_thread NO_RETURN;
+
+/* Write-behind.  dirty_cnt is only updated with interrupts off,
+   and read by the flusher without synchronization.  The flusher
+   sleeps on dirty_sema while nothing is dirty, and set_dirty()
+   ups it whenever dirty_cnt goes from 0 to 1. */
+#define FLUSH_INTERVAL (5 * TIMER_FREQ) /* Maximum ticks between flushes. */
+#define FLUSH_POLL TIMER_FREQ           /* Ticks between checks of dirty_cnt. */
+#define DIRTY_HIGH (CACHE_SIZE / 2)     /* Flush early beyond this many dirty sectors. */
+static size_t dirty_cnt;
+static struct semaphore dirty_sema;
+
+static thread_func flusher_thread NO_RETURN;
+static void set_dirty(struct cache_entry*, bool);
+
+static struct cache_entry* lookup(block_sector_t);
+static struct cache_entry* cache_get(block_sector_t);
+static void cache_put(struct cache_entry*);
+static struct cache_entry* find_victim(void);
+static void write_back(struct cache_entry*);
+static void write_sector(block_sector_t, const void*, size_t ofs, size_t size, bool journal);
+
+/* Initializes the buffer cache. */
+void cache_init(void) {
+  uint8_t* data;
+  size_t i;
+
+  data = palloc_get_multiple(PAL_ASSERT, CACHE_SIZE * BLOCK_SECTOR_SIZE / PGSIZE);
+  for (i = 0; i < CACHE_SIZE; i++) {
+    struct cache_entry* e = &cache[i];
+    e->in_use = false;
+    e->accessed = false;
+    e->pin_cnt = 0;
+    e->evicting = false;
+    lock_init(&e->lock);
+    e->valid = false;
+    e->dirty = false;
+    e->journaled = false;
+    e->data = data + i * BLOCK_SECTOR_SIZE;
+  }
+  lock_init(&cache_lock);
+  cond_init(&cache_unpinned);
+  cond_init(&eviction_done);
+  clock_hand = 0;
+
+  lock_init(&read_ahead_lock);
+  cond_init(&read_ahead_ready);
+  read_ahead_head = read_ahead_cnt = 0;
+  thread_create("read-ahead", PRI_DEFAULT, read_ahead_thread, NULL);
+
+  dirty_cnt = 0;
+  sema_init(&dirty_sema, 0);
+  thread_create("flusher", PRI_DEFAULT, flusher_thread, NULL);
+}
+
+/* Writes all dirty sectors back to the device.  Called when the
+   file system is shut down. */
+void cache_done(void) { cache_flush(); }
+
+/* Prints cache statistics. */
+void cache_print_stats(void) {
+  printf("Cache: %lld hits, %lld misses, %lld sectors read directly\n", hit_cnt, miss_cnt,
+         direct_cnt);
+}
+
+/* Reads SIZE bytes starting at byte OFS of SECTOR into BUFFER. */
+void cache_read(block_sector_t sector, void* buffer, size_t ofs, size_t size) {
+  struct cache_entry* e;
+
+  ASSERT(ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get(sector);
+  if (!e->valid) {
+    block_read(fs_device, sector, e->data);
+    e->valid = true;
+  }
+  memcpy(buffer, e->data + ofs, size);
+  cache_put(e);
+}
+
+/* Reads all of SECTOR into BUFFER.  If SECTOR is cached, copies
+   it out of the cache.  Otherwise, has the device transfer it
+   directly into BUFFER, leaving the cache alone, which saves a
+   copy and keeps a large sequential read from evicting
+   everything else; read-ahead still caches the sectors such a
+   reader is about to need.  Because the sector is not cached
+   afterward, this is meant only for reads larger than the whole
+   cache, which could not keep their sectors cached anyway.
+   Buffers outside the kernel's mapping of physical memory cannot
+   be handed to the device, so they are read through the cache. */
+void cache_read_sector(block_sector_t sector, void* buffer) {
+  struct cache_entry* e;
+
+  if (!is_kernel_vaddr(buffer)) {
+    cache_read(sector, buffer, 0, BLOCK_SECTOR_SIZE);
+    return;
+  }
+
+  /* A sector that is not cached at this point is up to date on
+     the device, because eviction writes a sector back before it
+     leaves the cache. */
+  lock_acquire(&cache_lock);
+  e = lookup(sector);
+  if (e != NULL) {
+    hit_cnt++;
+    e->pin_cnt++;
+    e->accessed = true;
+  } else
+    direct_cnt++;
+  lock_release(&cache_lock);
+
+  if (e == NULL) {
+    block_read(fs_device, sector, buffer);
+    return;
+  }
+
+  lock_acquire(&e->lock);
+  ASSERT(e->in_use && e->sector == sector);
+  if (!e->valid) {
+    block_read(fs_device, sector, e->data);
+    e->valid = true;
+  }
+  memcpy(buffer, e->data, BLOCK_SECTOR_SIZE);
+  cache_put(e);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR, starting at byte
+   OFS.  The sector is written back to the device later.  Inside a
+   journal handle, the sector joins the running transaction. */
+void cache_write(block_sector_t sector, const void* buffer, size_t ofs, size_t size) {
+  write_sector(sector, buffer, ofs, size, true);
+}
+
+/* Like cache_write(), but for file data, which never joins the
+   running transaction, even inside a journal handle. */
+void cache_write_data(block_sector_t sector, const void* buffer, size_t ofs, size_t size) {
+  write_sector(sector, buffer, ofs, size, false);
+}
+
+/* Marks SECTOR, which must be cached and journaled, as no longer
+   part of the running transaction, so that it may be written
+   back.  Called by the journal once the transaction is
+   committed. */
+void cache_unjournal(block_sector_t sector) {
+  struct cache_entry* e = cache_get(sector);
+
+  ASSERT(e->valid && e->journaled);
+  e->journaled = false;
+  cache_put(e);
+}
+
+/* Asks for SECTOR to be read into the cache in the background.
+   Does nothing if too many requests are already pending. */
+void cache_read_ahead(block_sector_t sector) {
+  lock_acquire(&read_ahead_lock);
+  if (read_ahead_cnt < READ_AHEAD_QUEUE_SIZE) {
+    read_ahead_queue[(read_ahead_head + read_ahead_cnt++) % READ_AHEAD_QUEUE_SIZE] = sector;
+    cond_signal(&read_ahead_ready, &read_ahead_lock);
+  }
+  lock_release(&read_ahead_lock);
+}
+
+/* Reads the sectors queued by cache_read_ahead() into the
+   cache. */
+static void read_ahead_thread(void* aux UNUSED) {
+  for (;;) {
+    struct cache_entry* e;
+    block_sector_t sector;
+
+    lock_acquire(&read_ahead_lock);
+    while (read_ahead_cnt == 0)
+      cond_wait(&read_ahead_ready, &read_ahead_lock);
+    sector = read_ahead_queue[read_ahead_head];
+    read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_QUEUE_SIZE;
+    read_ahead_cnt--;
+    lock_release(&read_ahead_lock);
+
+    e = cache_get(sector);
+    if (!e->valid) {
+      block_read(fs_device, sector, e->data);
+      e->valid = true;
+    }
+    cache_put(e);
+  }
+}
+
+/* Writes dirty sectors back to the device FLUSH_INTERVAL ticks
+   after they become dirty, or sooner once many sectors are dirty.
+   Sleeps without waking up at all while nothing is dirty. */
+static void flusher_thread(void* aux UNUSED) {
+  for (;;) {
+    sema_down(&dirty_sema);
+    while (dirty_cnt > 0) {
+      int64_t start = timer_ticks();
+
+      while (dirty_cnt <= DIRTY_HIGH && timer_elapsed(start) < FLUSH_INTERVAL)
+        timer_sleep(FLUSH_POLL);
+      free_map_flush();
+      journal_commit();
+      cache_flush();
+    }
+  }
+}
+
+/* Writes every dirty sector back to the device. */
+void cache_flush(void) {
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++) {
+    struct cache_entry* e = &cache[i];
+    lock_acquire(&e->lock);
+    write_back(e);
+    lock_release(&e->lock);
+  }
+}
+
+/* Returns the entry for SECTOR, loading it into the cache if
+   necessary, pinned and with its lock held.  The entry's data is
+   valid only if its valid flag is set. */
+static struct cache_entry* cache_get(block_sector_t sector) {
+  struct cache_entry* e;
+  block_sector_t old_sector;
+  bool write;
+
+  lock_acquire(&cache_lock);
+  e = lookup(sector);
+  if (e != NULL) {
+    hit_cnt++;
+    e->pin_cnt++;
+    e->accessed = true;
+    lock_release(&cache_lock);
+
+    lock_acquire(&e->lock);
+    ASSERT(e->in_use && e->sector == sector);
+    return e;
+  }
+  miss_cnt++;
+
+  /* Take over a victim, whose lock find_victim() acquired.  It is
+     assigned to SECTOR right away, so that lookups of SECTOR find
+     it and wait for its lock, while its old contents are written
+     back without holding cache_lock. */
+  e = find_victim();
+  old_sector = e->sector;
+  write = e->in_use && e->valid && e->dirty;
+  if (write) {
+    e->evicting = true;
+    e->evicted = old_sector;
+  }
+  e->sector = sector;
+  e->in_use = true;
+  e->pin_cnt++;
+  e->accessed = true;
+  lock_release(&cache_lock);
+
+  if (write) {
+    block_write(fs_device, old_sector, e->data);
+    set_dirty(e, false);
+
+    lock_acquire(&cache_lock);
+    e->evicting = false;
+    cond_broadcast(&eviction_done, &cache_lock);
+    lock_release(&cache_lock);
+  }
+  e->valid = false;
+  return e;
+}
+
+/* Returns the entry assigned to SECTOR, or a null pointer if
+   SECTOR is not cached.  If SECTOR is still being written back by
+   an eviction, first waits for the write to finish, so that a
+   caller that does not find SECTOR may read it from the device.
+   cache_lock must be held. */
+static struct cache_entry* lookup(block_sector_t sector) {
+  ASSERT(lock_held_by_current_thread(&cache_lock));
+
+  for (;;) {
+    bool evicting = false;
+    size_t i;
+
+    for (i = 0; i < CACHE_SIZE; i++) {
+      if (cache[i].in_use && cache[i].sector == sector)
+        return &cache[i];
+      if (cache[i].evicting && cache[i].evicted == sector)
+        evicting = true;
+    }
+    if (!evicting)
+      return NULL;
+    cond_wait(&eviction_done, &cache_lock);
+  }
+}
+
+/* Releases entry E, obtained from cache_get(). */
+static void cache_put(struct cache_entry* e) {
+  lock_release(&e->lock);
+
+  lock_acquire(&cache_lock);
+  ASSERT(e->pin_cnt > 0);
+  if (--e->pin_cnt == 0)
+    cond_signal(&cache_unpinned, &cache_lock);
+  lock_release(&cache_lock);
+}
+
+/* Chooses an entry to evict using the clock algorithm, waiting
+   for one to be unpinned if all of them are pinned, and returns
+   it with its lock held.  Entries whose lock is busy, because
+   cache_flush() is writing them back, are passed over rather than
+   waited for.  cache_lock must be held. */
+static struct cache_entry* find_victim(void) {
+  ASSERT(lock_held_by_current_thread(&cache_lock));
+
+  for (;;) {
+    size_t i;
+
+    /* Two sweeps: the first may only clear accessed bits. */
+    for (i = 0; i < 2 * CACHE_SIZE; i++) {
+      struct cache_entry* e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+      if (e->pin_cnt > 0 || e->journaled)
+        continue;
+      if (e->in_use && e->accessed)
+        e->accessed = false;
+      else if (lock_try_acquire(&e->lock))
+        return e;
+    }
+    cond_wait(&cache_unpinned, &cache_lock);
+  }
+}
+
+/* Writes E back to the device if it is dirty and not journaled.
+   E's lock must be held. */
+static void write_back(struct cache_entry* e) {
+  ASSERT(lock_held_by_current_thread(&e->lock));
+
+  if (e->valid && e->dirty && !e->journaled) {
+    block_write(fs_device, e->sector, e->data);
+    set_dirty(e, false);
+  }
+}
+
+/* Sets E's dirty flag to DIRTY, keeping dirty_cnt up to date.
+   E's lock must be held. */
+static void set_dirty(struct cache_entry* e, bool dirty) {
+  enum intr_level old_level;
+
+  ASSERT(lock_held_by_current_thread(&e->lock));
+
+  if (e->dirty != dirty) {
+    e->dirty = dirty;
+    old_level = intr_disable();
+    if (dirty) {
+      if (dirty_cnt++ == 0)
+        sema_up(&dirty_sema);
+    } else
+      dirty_cnt--;
+    intr_set_level(old_level);
+  }
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR, starting at byte
+   OFS.  If JOURNAL is true and the running thread is inside a
+   journal handle, adds the sector to the running transaction. */
+static void write_sector(block_sector_t sector, const void* buffer, size_t ofs, size_t size,
+                         bool journal) {
+  struct cache_entry* e;
+
+  ASSERT(ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get(sector);
+  if (!e->valid) {
+    /* No need to read a sector that is about to be overwritten
+       completely. */
+    if (size < BLOCK_SECTOR_SIZE)
+      block_read(fs_device, sector, e->data);
+    e->valid = true;
+  }
+  memcpy(e->data + ofs, buffer, size);
+  set_dirty(e, true);
+  if (journal && !e->journaled && journal_active()) {
+    e->journaled = true;
+    journal_add(sector);
+  }
+  cache_put(e);
+}
@@ -0,0 +1,21 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Number of cached sectors. */
+#define CACHE_SIZE 64
+
+void cache_init(void);
+void cache_done(void);
+void cache_print_stats(void);
+void cache_read(block_sector_t, void* buffer, size_t ofs, size_t size);
+void cache_read_sector(block_sector_t, void* buffer);
+void cache_write(block_sector_t, const void* buffer, size_t ofs, size_t size);
+void cache_write_data(block_sector_t, const void* buffer, size_t ofs, size_t size);
+void cache_read_ahead(block_sector_t);
+void cache_flush(void);
+void cache_unjournal(block_sector_t);
+
+#endif /* filesys/cache.h */
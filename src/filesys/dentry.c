@@ -0,0 +1,175 @@
+#include "filesys/dentry.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.
+
+   Remembers the results of recent name lookups, so that looking
+   up the same name in the same directory again does not read
+   the directory.  Entries are keyed by the sector of the
+   directory's inode and the name.  An entry either gives the
+   sector of the named file's inode or, as a negative entry,
+   records that the directory has no such name.
+
+   dir_add() and dir_remove() keep the cache up to date by
+   inserting the new state of the name they changed, so cached
+   entries never go stale.  At most DENTRY_MAX entries are kept;
+   beyond that, the least recently used entry is discarded.
+
+   A lookup that misses reads the directory and then caches what
+   it found with dentry_fill().  A dir_add() or dir_remove() may
+   have changed the name in between, after the lookup read the
+   directory, so that what it found is already out of date.  Every
+   update therefore bumps a generation number, and dentry_fill()
+   drops its result if the generation has changed since the miss
+   was reported. */
+
+/* Maximum number of cached entries. */
+#define DENTRY_MAX 256
+
+/* A cached name lookup. */
+struct dentry {
+  struct hash_elem hash_elem; /* Element in dentries. */
+  struct list_elem lru_elem;  /* Element in lru_list. */
+  block_sector_t parent;      /* Directory's inode sector. */
+  char name[NAME_MAX + 1];    /* Name within the directory. */
+  block_sector_t sector;      /* Named inode's sector, or 0 if none. */
+};
+
+static struct hash dentries;           /* All cached entries. */
+static struct list lru_list;           /* Entries, most recently used first. */
+static unsigned generation;            /* Number of updates so far. */
+static struct lock dentry_lock;        /* Protects everything above. */
+static struct slab_cache dentry_cache; /* Cache of struct dentry. */
+
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+static struct dentry* find(block_sector_t parent, const char* name);
+static void store(block_sector_t parent, const char* name, block_sector_t sector);
+
+/* Initializes the directory entry cache. */
+void dentry_init(void) {
+  if (!hash_init(&dentries, dentry_hash, dentry_less, NULL))
+    PANIC("can't create directory entry cache");
+  list_init(&lru_list);
+  generation = 0;
+  lock_init(&dentry_lock);
+  slab_cache_init(&dentry_cache, "dentry", sizeof(struct dentry), 0, NULL);
+}
+
+/* Looks up NAME in the directory whose inode is in sector
+   PARENT.  If the cache knows the answer, stores the sector of
+   the named inode into *SECTOR, or 0 if the directory has no
+   such name, and returns true.  Otherwise, stores the current
+   generation into *GENERATION, for passing to dentry_fill(), and
+   returns false. */
+bool dentry_lookup(block_sector_t parent, const char* name, block_sector_t* sector,
+                   unsigned* generation_) {
+  struct dentry* d;
+
+  lock_acquire(&dentry_lock);
+  d = find(parent, name);
+  if (d != NULL) {
+    list_remove(&d->lru_elem);
+    list_push_front(&lru_list, &d->lru_elem);
+    *sector = d->sector;
+  } else
+    *generation_ = generation;
+  lock_release(&dentry_lock);
+
+  return d != NULL;
+}
+
+/* Caches SECTOR, read from the directory after dentry_lookup()
+   missed and returned GENERATION_, as the result of looking up
+   NAME in PARENT.  Does nothing if the directory may have changed
+   since. */
+void dentry_fill(block_sector_t parent, const char* name, block_sector_t sector,
+                 unsigned generation_) {
+  lock_acquire(&dentry_lock);
+  if (generation_ == generation)
+    store(parent, name, sector);
+  lock_release(&dentry_lock);
+}
+
+/* Records that NAME in the directory whose inode is in sector
+   PARENT now refers to the inode in SECTOR, or that the directory
+   no longer has such a name if SECTOR is 0.  Called after the
+   directory itself has been changed. */
+void dentry_insert(block_sector_t parent, const char* name, block_sector_t sector) {
+  lock_acquire(&dentry_lock);
+  generation++;
+  store(parent, name, sector);
+  lock_release(&dentry_lock);
+}
+
+/* Records SECTOR as the result of looking up NAME in PARENT.
+   Names that are too long to be in any directory are not cached.
+   dentry_lock must be held. */
+static void store(block_sector_t parent, const char* name, block_sector_t sector) {
+  struct dentry* d;
+
+  ASSERT(lock_held_by_current_thread(&dentry_lock));
+
+  if (strlen(name) > NAME_MAX)
+    return;
+
+  d = find(parent, name);
+  if (d != NULL)
+    list_remove(&d->lru_elem);
+  else {
+    if (hash_size(&dentries) >= DENTRY_MAX) {
+      /* Recycle the least recently used entry. */
+      d = list_entry(list_pop_back(&lru_list), struct dentry, lru_elem);
+      hash_delete(&dentries, &d->hash_elem);
+    } else
+      d = slab_alloc(&dentry_cache);
+
+    if (d == NULL)
+      return;
+    d->parent = parent;
+    strlcpy(d->name, name, sizeof d->name);
+    hash_insert(&dentries, &d->hash_elem);
+  }
+  d->sector = sector;
+  list_push_front(&lru_list, &d->lru_elem);
+}
+
+/* Returns the cached entry for NAME in PARENT, or a null
+   pointer if there is none.  dentry_lock must be held. */
+static struct dentry* find(block_sector_t parent, const char* name) {
+  struct dentry key;
+  struct hash_elem* e;
+
+  ASSERT(lock_held_by_current_thread(&dentry_lock));
+
+  if (strlen(name) > NAME_MAX)
+    return NULL;
+  key.parent = parent;
+  strlcpy(key.name, name, sizeof key.name);
+  e = hash_find(&dentries, &key.hash_elem);
+  return e != NULL ? hash_entry(e, struct dentry, hash_elem) : NULL;
+}
+
+/* Returns a hash value for the entry containing E. */
+static unsigned dentry_hash(const struct hash_elem* e, void* aux UNUSED) {
+  const struct dentry* d = hash_entry(e, struct dentry, hash_elem);
+  return hash_string(d->name) ^ hash_int(d->parent);
+}
+
+/* Returns true if the entry containing A precedes the one
+   containing B. */
+static bool dentry_less(const struct hash_elem* a_, const struct hash_elem* b_,
+                        void* aux UNUSED) {
+  const struct dentry* a = hash_entry(a_, struct dentry, hash_elem);
+  const struct dentry* b = hash_entry(b_, struct dentry, hash_elem);
+
+  if (a->parent != b->parent)
+    return a->parent < b->parent;
+  return strcmp(a->name, b->name) < 0;
+}
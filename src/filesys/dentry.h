@@ -0,0 +1,13 @@
+#ifndef FILESYS_DENTRY_H
+#define FILESYS_DENTRY_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+void dentry_init(void);
+bool dentry_lookup(block_sector_t parent, const char* name, block_sector_t*,
+                   unsigned* generation);
+void dentry_fill(block_sector_t parent, const char* name, block_sector_t, unsigned generation);
+void dentry_insert(block_sector_t parent, const char* name, block_sector_t);
+
+#endif /* filesys/dentry.h */
@@ -1,10 +1,14 @@
 #include "filesys/directory.h"
+#include <dirent.h>
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <round.h>
+#include "filesys/dentry.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
 
 /* A directory. */
 struct dir {
@@ -12,6 +16,10 @@ struct dir {
   off_t pos;           /* Current position. */
 };
 
+#if NAME_MAX != DIRENT_NAME_MAX
+#error NAME_MAX and DIRENT_NAME_MAX must agree
+#endif
+
 /* A single directory entry. */
 struct dir_entry {
   block_sector_t inode_sector; /* Sector number of header. */
@@ -19,23 +27,74 @@ struct dir_entry {
   bool in_use;                 /* In use or free? */
 };
 
-/* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
-bool dir_create(block_sector_t sector, size_t entry_cnt) {
-  return inode_create(sector, entry_cnt * sizeof(struct dir_entry));
+/* Hashed directory layout.
+
+   A directory starts with a header sector that holds
+   DIR_MAGIC and the first sector of each of DIR_BUCKET_CNT hash
+   buckets.  A name is stored in the bucket selected by its hash.
+   Each bucket is a chain of sectors, each with room for
+   ENTRIES_PER_BUCKET entries and the position of the next sector
+   in the chain.  Sectors are named by their index within the
+   directory, and 0 (the header) ends a chain.  Bucket sectors are
+   appended to the directory as they are needed, so a lookup
+   only reads the sectors of one bucket.
+
+   Adding or removing an entry looks for a slot and then writes
+   it, so both hold the directory inode's directory lock, which
+   keeps two of them from choosing the same slot. */
+#define DIR_MAGIC 0x48524944
+#define DIR_BUCKET_CNT 64
+#define ENTRIES_PER_BUCKET ((BLOCK_SECTOR_SIZE - sizeof(uint32_t)) / sizeof(struct dir_entry))
+
+/* Header sector of a directory. */
+struct dir_header {
+  uint32_t magic;                   /* DIR_MAGIC. */
+  uint32_t buckets[DIR_BUCKET_CNT]; /* First sector of each bucket. */
+};
+
+/* One sector of a bucket in a directory. */
+struct dir_bucket {
+  struct dir_entry entries[ENTRIES_PER_BUCKET]; /* Entries. */
+  uint32_t next;                                /* Next sector in chain. */
+};
+
+/* Cache of struct dir. */
+static struct slab_cache dir_cache;
+
+/* Initializes the directory module. */
+void dir_init(void) {
+  slab_cache_init(&dir_cache, "dir", sizeof(struct dir), 0, NULL);
+  dentry_init();
+}
+
+/* Creates an empty directory in the given SECTOR.  A directory
+   grows as entries are added to it, so ENTRY_CNT is only a hint
+   and is currently unused.  Returns true if successful, false on
+   failure. */
+bool dir_create(block_sector_t sector, size_t entry_cnt UNUSED) {
+  const uint32_t magic = DIR_MAGIC;
+  struct inode* inode;
+  bool success;
+
+  if (!inode_create(sector, sizeof(struct dir_header)))
+    return false;
+  inode = inode_open(sector);
+  success = inode != NULL && inode_write_at(inode, &magic, sizeof magic, 0) == sizeof magic;
+  inode_close(inode);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
    it takes ownership.  Returns a null pointer on failure. */
 struct dir* dir_open(struct inode* inode) {
-  struct dir* dir = calloc(1, sizeof *dir);
+  struct dir* dir = slab_zalloc(&dir_cache);
   if (inode != NULL && dir != NULL) {
     dir->inode = inode;
     dir->pos = 0;
     return dir;
   } else {
     inode_close(inode);
-    free(dir);
+    slab_free(&dir_cache, dir);
     return NULL;
   }
 }
@@ -56,7 +115,7 @@ struct dir* dir_reopen(struct dir* dir) {
 void dir_close(struct dir* dir) {
   if (dir != NULL) {
     inode_close(dir->inode);
-    free(dir);
+    slab_free(&dir_cache, dir);
   }
 }
 
@@ -65,47 +124,119 @@ struct inode* dir_get_inode(struct dir* dir) {
   return dir->inode;
 }
 
+/* Returns the byte offset within a directory of the sector with
+   index IDX. */
+static off_t sector_ofs(uint32_t idx) { return (off_t)idx * BLOCK_SECTOR_SIZE; }
+
+/* Returns the byte offset within a directory of the header
+   slot that points to the first sector of NAME's
+   bucket. */
+static off_t bucket_ofs(const char* name) {
+  return offsetof(struct dir_header, buckets) + hash_string(name) % DIR_BUCKET_CNT * sizeof(uint32_t);
+}
+
+/* Reads the word at byte offset OFS in DIR, which must be a
+   sector index.  Returns 0 on failure, which ends a chain. */
+static uint32_t read_link(const struct dir* dir, off_t ofs) {
+  uint32_t idx;
+  return inode_read_at(dir->inode, &idx, sizeof idx, ofs) == sizeof idx ? idx : 0;
+}
+
+/* Reads the bucket sector with index IDX in DIR into B.
+   Returns true if successful, false on failure. */
+static bool read_bucket(const struct dir* dir, uint32_t idx, struct dir_bucket* b) {
+  return inode_read_at(dir->inode, b, sizeof *b, sector_ofs(idx)) == sizeof *b;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
    otherwise, returns false and ignores EP and OFSP. */
 static bool lookup(const struct dir* dir, const char* name, struct dir_entry* ep, off_t* ofsp) {
-  struct dir_entry e;
-  size_t ofs;
+  struct dir_bucket b;
+  uint32_t idx;
+  size_t i;
 
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
 
-  for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e)
-    if (e.in_use && !strcmp(name, e.name)) {
-      if (ep != NULL)
-        *ep = e;
-      if (ofsp != NULL)
-        *ofsp = ofs;
-      return true;
-    }
+  for (idx = read_link(dir, bucket_ofs(name)); idx != 0; idx = b.next) {
+    if (!read_bucket(dir, idx, &b))
+      break;
+    for (i = 0; i < ENTRIES_PER_BUCKET; i++)
+      if (b.entries[i].in_use && !strcmp(name, b.entries[i].name)) {
+        if (ep != NULL)
+          *ep = b.entries[i];
+        if (ofsp != NULL)
+          *ofsp = sector_ofs(idx) + i * sizeof b.entries[i];
+        return true;
+      }
+  }
   return false;
 }
 
+/* Returns the sector of the inode for the file named NAME in
+   DIR, or 0 if DIR has no such file, consulting the directory
+   entry cache before reading DIR itself. */
+static block_sector_t lookup_cached(const struct dir* dir, const char* name) {
+  block_sector_t parent = inode_get_inumber(dir->inode);
+  block_sector_t sector;
+  unsigned generation;
+  struct dir_entry e;
+
+  if (!dentry_lookup(parent, name, &sector, &generation)) {
+    sector = lookup(dir, name, &e, NULL) ? e.inode_sector : 0;
+    dentry_fill(parent, name, sector, generation);
+  }
+  return sector;
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
    a null pointer.  The caller must close *INODE. */
 bool dir_lookup(const struct dir* dir, const char* name, struct inode** inode) {
-  struct dir_entry e;
+  block_sector_t sector;
 
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
 
-  if (lookup(dir, name, &e, NULL))
-    *inode = inode_open(e.inode_sector);
-  else
-    *inode = NULL;
+  sector = lookup_cached(dir, name);
+  *inode = sector != 0 ? inode_open(sector) : NULL;
 
   return *inode != NULL;
 }
 
+/* Stores E, whose name is not yet in DIR, in the first free
+   slot in its bucket, appending a new sector to the bucket if all
+   of its sectors are full.  DIR's directory lock must be held.
+   Returns true if successful, false on failure. */
+static bool add_entry(struct dir* dir, const struct dir_entry* e) {
+  struct dir_bucket b;
+  off_t link_ofs = bucket_ofs(e->name);
+  uint32_t idx;
+  size_t i;
+
+  for (idx = read_link(dir, link_ofs); idx != 0; idx = b.next) {
+    if (!read_bucket(dir, idx, &b))
+      return false;
+    for (i = 0; i < ENTRIES_PER_BUCKET; i++)
+      if (!b.entries[i].in_use)
+        return (inode_write_at(dir->inode, e, sizeof *e, sector_ofs(idx) + i * sizeof *e) ==
+                sizeof *e);
+    link_ofs = sector_ofs(idx) + offsetof(struct dir_bucket, next);
+  }
+
+  /* Every sector in the bucket is full.  Append a new sector
+     holding E to the directory, then link it into the chain. */
+  memset(&b, 0, sizeof b);
+  b.entries[0] = *e;
+  idx = DIV_ROUND_UP(inode_length(dir->inode), BLOCK_SECTOR_SIZE);
+  return (inode_write_at(dir->inode, &b, sizeof b, sector_ofs(idx)) == sizeof b &&
+          inode_write_at(dir->inode, &idx, sizeof idx, link_ofs) == sizeof idx);
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
@@ -114,7 +245,6 @@ bool dir_lookup(const struct dir* dir, const char* name, struct inode** inode) {
    error occurs. */
 bool dir_add(struct dir* dir, const char* name, block_sector_t inode_sector) {
   struct dir_entry e;
-  off_t ofs;
   bool success = false;
 
   ASSERT(dir != NULL);
@@ -124,28 +254,19 @@ bool dir_add(struct dir* dir, const char* name, block_sector_t inode_sector) {
   if (*name == '\0' || strlen(name) > NAME_MAX)
     return false;
 
-  /* Check that NAME is not in use. */
-  if (lookup(dir, name, NULL, NULL))
-    goto done;
-
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e)
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
+  /* Fill in the new entry. */
+  memset(&e, 0, sizeof e);
   e.in_use = true;
   strlcpy(e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
 
-done:
+  /* Check that NAME is not in use, and store the entry. */
+  inode_dir_lock(dir->inode);
+  if (lookup_cached(dir, name) == 0 && add_entry(dir, &e)) {
+    dentry_insert(inode_get_inumber(dir->inode), name, inode_sector);
+    success = true;
+  }
+  inode_dir_unlock(dir->inode);
   return success;
 }
 
@@ -161,6 +282,8 @@ bool dir_remove(struct dir* dir, const char* name) {
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
 
+  inode_dir_lock(dir->inode);
+
   /* Find directory entry. */
   if (!lookup(dir, name, &e, &ofs))
     goto done;
@@ -177,25 +300,72 @@ bool dir_remove(struct dir* dir, const char* name) {
 
   /* Remove inode. */
   inode_remove(inode);
+  dentry_insert(inode_get_inumber(dir->inode), name, 0);
   success = true;
 
 done:
+  inode_dir_unlock(dir->inode);
   inode_close(inode);
   return success;
 }
 
+/* Reads the next entry in use in DIR into *EP and advances DIR's
+   position past it.  Returns true if successful, false if the
+   directory contains no more entries. */
+static bool next_entry(struct dir* dir, struct dir_entry* ep) {
+  for (;;) {
+    /* Visit the entries of every bucket sector in the order they
+       appear in the directory, skipping the header and the chain
+       links. */
+    if (dir->pos < BLOCK_SECTOR_SIZE)
+      dir->pos = BLOCK_SECTOR_SIZE;
+    else if (dir->pos % BLOCK_SECTOR_SIZE >= (off_t)(ENTRIES_PER_BUCKET * sizeof *ep))
+      dir->pos = ROUND_UP(dir->pos, BLOCK_SECTOR_SIZE);
+
+    if (inode_read_at(dir->inode, ep, sizeof *ep, dir->pos) != sizeof *ep)
+      return false;
+    dir->pos += sizeof *ep;
+    if (ep->in_use)
+      return true;
+  }
+}
+
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
    contains no more entries. */
 bool dir_readdir(struct dir* dir, char name[NAME_MAX + 1]) {
   struct dir_entry e;
 
-  while (inode_read_at(dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
-    dir->pos += sizeof e;
-    if (e.in_use) {
-      strlcpy(name, e.name, NAME_MAX + 1);
-      return true;
-    }
+  if (!next_entry(dir, &e))
+    return false;
+  strlcpy(name, e.name, NAME_MAX + 1);
+  return true;
+}
+
+/* Reads up to CNT of the next directory entries in DIR into
+   ENTRIES.  Returns the number of entries read, which is 0 once
+   the directory contains no more entries.  DIR's position, as
+   returned by dir_tell(), serves as the cookie for resuming
+   where a previous call stopped.
+
+   Inodes do not record whether they are directories, so every
+   entry's type is DT_UNKNOWN. */
+size_t dir_getdents(struct dir* dir, struct dirent* entries, size_t cnt) {
+  struct dir_entry e;
+  size_t i;
+
+  for (i = 0; i < cnt && next_entry(dir, &e); i++) {
+    entries[i].inumber = e.inode_sector;
+    entries[i].type = DT_UNKNOWN;
+    strlcpy(entries[i].name, e.name, sizeof entries[i].name);
   }
-  return false;
+  return i;
 }
+
+/* Returns the position in DIR at which the next entry will be
+   read. */
+off_t dir_tell(struct dir* dir) { return dir->pos; }
+
+/* Sets DIR's position to POS, which must have been returned by
+   dir_tell() on the same directory. */
+void dir_seek(struct dir* dir, off_t pos) { dir->pos = pos; }
@@ -4,6 +4,8 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "devices/block.h"
+#include "filesys/inode.h"
+#include "filesys/off_t.h"
 
 /* Maximum length of a file name component.
    This is the traditional UNIX maximum length.
@@ -12,9 +14,15 @@
 #define NAME_MAX 14
 
 struct inode;
+struct dirent;
+
+/* Most sectors that dir_add() adds to a journal transaction: a
+   bucket sector appended to the directory, and the link to it. */
+#define DIR_ADD_CREDITS (INODE_WRITE_CREDITS + 1)
 
 /* Opening and closing directories. */
 bool dir_create(block_sector_t sector, size_t entry_cnt);
+void dir_init(void);
 struct dir* dir_open(struct inode*);
 struct dir* dir_open_root(void);
 struct dir* dir_reopen(struct dir*);
@@ -26,5 +34,8 @@ bool dir_lookup(const struct dir*, const char* name, struct inode**);
 bool dir_add(struct dir*, const char* name, block_sector_t);
 bool dir_remove(struct dir*, const char* name);
 bool dir_readdir(struct dir*, char name[NAME_MAX + 1]);
+size_t dir_getdents(struct dir*, struct dirent*, size_t cnt);
+off_t dir_tell(struct dir*);
+void dir_seek(struct dir*, off_t);
 
 #endif /* filesys/directory.h */
@@ -1,28 +1,48 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
+
+/* Read-ahead window limits, in sectors.  Each sequential read
+   doubles the window, up to READ_AHEAD_MAX. */
+#define READ_AHEAD_MIN 2
+#define READ_AHEAD_MAX 32
 
 /* An open file. */
 struct file {
   struct inode* inode; /* File's inode. */
   off_t pos;           /* Current position. */
   bool deny_write;     /* Has file_deny_write() been called? */
+
+  /* Sequential access detection. */
+  off_t ra_next;       /* Offset a sequential read would start at. */
+  off_t ra_end;        /* End of what has been read ahead. */
+  int ra_window;       /* Sectors to read ahead, 0 if not sequential. */
 };
 
+static void read_ahead(struct file*, off_t ofs, off_t bytes_read);
+
+/* Cache of struct file. */
+static struct slab_cache file_cache;
+
+/* Initializes the file module. */
+void file_init(void) { slab_cache_init(&file_cache, "file", sizeof(struct file), 0, NULL); }
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
 struct file* file_open(struct inode* inode) {
-  struct file* file = calloc(1, sizeof *file);
+  struct file* file = slab_zalloc(&file_cache);
   if (inode != NULL && file != NULL) {
     file->inode = inode;
     file->pos = 0;
     file->deny_write = false;
+    file->ra_next = file->ra_end = 0;
+    file->ra_window = 0;
     return file;
   } else {
     inode_close(inode);
-    free(file);
+    slab_free(&file_cache, file);
     return NULL;
   }
 }
@@ -38,7 +58,7 @@ void file_close(struct file* file) {
   if (file != NULL) {
     file_allow_write(file);
     inode_close(file->inode);
-    free(file);
+    slab_free(&file_cache, file);
   }
 }
 
@@ -54,6 +74,7 @@ struct inode* file_get_inode(struct file* file) {
    Advances FILE's position by the number of bytes read. */
 off_t file_read(struct file* file, void* buffer, off_t size) {
   off_t bytes_read = inode_read_at(file->inode, buffer, size, file->pos);
+  read_ahead(file, file->pos, bytes_read);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -64,15 +85,47 @@ off_t file_read(struct file* file, void* buffer, off_t size) {
    which may be less than SIZE if end of file is reached.
    The file's current position is unaffected. */
 off_t file_read_at(struct file* file, void* buffer, off_t size, off_t file_ofs) {
-  return inode_read_at(file->inode, buffer, size, file_ofs);
+  off_t bytes_read = inode_read_at(file->inode, buffer, size, file_ofs);
+  read_ahead(file, file_ofs, bytes_read);
+  return bytes_read;
+}
+
+/* Called after reading BYTES_READ bytes from FILE at offset OFS.
+   If this read continues where the previous one ended, grows
+   the read-ahead window and asks for the sectors in it that have
+   not been requested yet to be read in the background.  Any
+   other access pattern shrinks the window back to zero. */
+static void read_ahead(struct file* file, off_t ofs, off_t bytes_read) {
+  off_t start, end;
+
+  if (bytes_read == 0)
+    return;
+
+  if (ofs != file->ra_next) {
+    file->ra_window = 0;
+    file->ra_next = file->ra_end = ofs + bytes_read;
+    return;
+  }
+
+  if (file->ra_window == 0)
+    file->ra_window = READ_AHEAD_MIN;
+  else if (file->ra_window < READ_AHEAD_MAX)
+    file->ra_window *= 2;
+  file->ra_next = ofs + bytes_read;
+
+  start = file->ra_end > file->ra_next ? file->ra_end : file->ra_next;
+  end = file->ra_next + file->ra_window * BLOCK_SECTOR_SIZE;
+  if (start < end) {
+    inode_read_ahead(file->inode, start, end - start);
+    file->ra_end = end;
+  }
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk is full.
+   Writing past end of file grows the file.
    Advances FILE's position by the number of bytes read. */
 off_t file_write(struct file* file, const void* buffer, off_t size) {
   off_t bytes_written = inode_write_at(file->inode, buffer, size, file->pos);
@@ -83,9 +136,8 @@ off_t file_write(struct file* file, const void* buffer, off_t size) {
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk is full.
+   Writing past end of file grows the file.
    The file's current position is unaffected. */
 off_t file_write_at(struct file* file, const void* buffer, off_t size, off_t file_ofs) {
   return inode_write_at(file->inode, buffer, size, file_ofs);
@@ -2,10 +2,12 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
 
 /* Partition that contains the file system. */
 struct block* fs_device;
@@ -19,7 +21,11 @@ void filesys_init(bool format) {
   if (fs_device == NULL)
     PANIC("No file system device found, can't initialize file system.");
 
+  cache_init();
+  journal_init(format);
   inode_init();
+  dir_init();
+  file_init();
   free_map_init();
 
   if (format)
@@ -30,20 +36,41 @@ void filesys_init(bool format) {
 
 /* Shuts down the file system module, writing any unwritten data
    to disk. */
-void filesys_done(void) { free_map_close(); }
+void filesys_done(void) {
+  free_map_close();
+  journal_done();
+  cache_done();
+}
+
+/* Writes all file system data that is still only in memory to
+   the device. */
+void filesys_sync(void) {
+  free_map_flush();
+  journal_commit();
+  cache_flush();
+}
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
-   or if internal memory allocation fails. */
+   or if internal memory allocation fails.
+   The new inode is placed in its directory's block group. */
 bool filesys_create(const char* name, off_t initial_size) {
   block_sector_t inode_sector = 0;
-  struct dir* dir = dir_open_root();
-  bool success = (dir != NULL && free_map_allocate(1, &inode_sector) &&
-                  inode_create(inode_sector, initial_size) && dir_add(dir, name, inode_sector));
+  struct dir* dir;
+  bool success;
+
+  /* The new inode, the free map sector that records its
+     allocation, and the new directory entry. */
+  journal_begin(2 + DIR_ADD_CREDITS);
+  dir = dir_open_root();
+  success = (dir != NULL &&
+             free_map_allocate_near(1, inode_get_inumber(dir_get_inode(dir)), &inode_sector) &&
+             inode_create(inode_sector, initial_size) && dir_add(dir, name, inode_sector));
   if (!success && inode_sector != 0)
     free_map_release(inode_sector, 1);
   dir_close(dir);
+  journal_end();
 
   return success;
 }
@@ -69,9 +96,16 @@ struct file* filesys_open(const char* name) {
    Fails if no file named NAME exists,
    or if an internal memory allocation fails. */
 bool filesys_remove(const char* name) {
-  struct dir* dir = dir_open_root();
-  bool success = dir != NULL && dir_remove(dir, name);
+  struct dir* dir;
+  bool success;
+
+  /* The erased directory entry, and the free map sectors of the
+     file's sectors, if this removes its last reference. */
+  journal_begin(1 + free_map_sectors());
+  dir = dir_open_root();
+  success = dir != NULL && dir_remove(dir, name);
   dir_close(dir);
+  journal_end();
 
   return success;
 }
@@ -1,45 +1,210 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+
+/* Free map.
+
+   The bitmap, one bit per sector, is the authoritative record of
+   which sectors are in use, and it is what is stored in the free
+   map file.  Allocation does not search it, though.  Instead, the
+   free sectors are also indexed as extents, maximal runs of free
+   sectors.  Each extent is hashed by its first sector and by the
+   sector just past its end, so that an allocation can continue
+   right where a previous one stopped, and a released run can be
+   merged with its neighbors without searching.  Extents are also
+   kept in lists by size class, for best-fit allocation.
+
+   The device is divided into block groups of GROUP_SECTORS
+   sectors each, and no extent crosses a group boundary.  Each
+   group has its own size class lists, so that an allocation can
+   be satisfied from the same group as its hint, as in ext2: new
+   inodes go in the group of their parent directory, and data goes
+   in the group of its inode.  Only when that group is full does
+   allocation move on to the following groups.
+
+   Only the sectors of the free map file that hold changed bits
+   are written.  Once the file is open, they are written into the
+   cache as soon as the bitmap changes, so that they join the
+   journal transaction of the operation that changed them and the
+   free map on disk always agrees with the inodes.  Sectors that
+   could not be written then are left for free_map_flush(). */
+
+/* A run of free sectors. */
+struct extent {
+  struct hash_elem start_elem; /* Element in extents_by_start. */
+  struct hash_elem end_elem;   /* Element in extents_by_end. */
+  struct list_elem size_elem;  /* Element in size_classes[]. */
+  block_sector_t start;        /* First sector. */
+  size_t cnt;                  /* Number of sectors. */
+};
+
+/* Number of sectors in a block group.  Must be a power of 2. */
+#define GROUP_SECTORS 512
+
+/* Number of size classes.  Class K holds the extents of 2**K to
+   2**(K+1) - 1 sectors, so that the last class holds extents that
+   cover a whole group. */
+#define SIZE_CLASS_CNT 10
+
+/* A block group. */
+struct block_group {
+  struct list size_classes[SIZE_CLASS_CNT]; /* Extents by size. */
+};
 
 static struct file* free_map_file; /* Free map file. */
 static struct bitmap* free_map;    /* Free map, one bit per sector. */
+static struct bitmap* dirty_map;   /* Free map file sectors not yet written. */
+static struct lock free_map_lock;  /* Protects all of the above. */
+
+static struct hash extents_by_start;   /* Extents by first sector. */
+static struct hash extents_by_end;     /* Extents by sector after last. */
+static struct block_group* groups;     /* Block groups. */
+static size_t group_cnt;               /* Number of block groups. */
+static struct slab_cache extent_cache; /* Cache of struct extent. */
+
+static hash_hash_func start_hash, end_hash;
+static hash_less_func start_less, end_less;
+static void index_free_map(void);
+static void insert_extent(block_sector_t start, size_t cnt);
+static void remove_extent(struct extent*);
+static struct extent* find_extent(struct hash*, block_sector_t);
+static struct extent* best_fit(struct block_group*, size_t cnt);
+static void release_extent(block_sector_t sector, size_t cnt);
+static void mark_dirty(block_sector_t sector, size_t cnt);
+static void write_dirty(void);
 
 /* Initializes the free map. */
 void free_map_init(void) {
+  size_t i, j;
+
   free_map = bitmap_create(block_size(fs_device));
   if (free_map == NULL)
     PANIC("bitmap creation failed--file system device is too large");
   bitmap_mark(free_map, FREE_MAP_SECTOR);
   bitmap_mark(free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple(free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+
+  dirty_map = bitmap_create(DIV_ROUND_UP(bitmap_file_size(free_map), BLOCK_SECTOR_SIZE));
+  if (dirty_map == NULL)
+    PANIC("can't create free map dirty bitmap");
+  lock_init(&free_map_lock);
+
+  if (!hash_init(&extents_by_start, start_hash, start_less, NULL) ||
+      !hash_init(&extents_by_end, end_hash, end_less, NULL))
+    PANIC("can't create free extent index");
+  group_cnt = DIV_ROUND_UP(bitmap_size(free_map), GROUP_SECTORS);
+  groups = malloc(group_cnt * sizeof *groups);
+  if (groups == NULL)
+    PANIC("can't create block groups");
+  for (i = 0; i < group_cnt; i++)
+    for (j = 0; j < SIZE_CLASS_CNT; j++)
+      list_init(&groups[i].size_classes[j]);
+  slab_cache_init(&extent_cache, "extent", sizeof(struct extent), 0, NULL);
+  index_free_map();
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
 bool free_map_allocate(size_t cnt, block_sector_t* sectorp) {
-  block_sector_t sector = bitmap_scan_and_flip(free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR && free_map_file != NULL && !bitmap_write(free_map, free_map_file)) {
-    bitmap_set_multiple(free_map, sector, cnt, false);
-    sector = BITMAP_ERROR;
+  return free_map_allocate_near(cnt, 0, sectorp);
+}
+
+/* Like free_map_allocate(), but prefers to allocate sectors
+   starting at HINT, or otherwise in HINT's block group, so that
+   data that is read together ends up together on disk.  A HINT
+   of 0 means there is no preference.  CNT may not exceed the
+   size of a block group. */
+bool free_map_allocate_near(size_t cnt, block_sector_t hint, block_sector_t* sectorp) {
+  struct extent* e;
+  block_sector_t sector;
+  size_t first_group = hint / GROUP_SECTORS;
+  size_t i;
+
+  ASSERT(cnt > 0);
+
+  lock_acquire(&free_map_lock);
+  e = hint != 0 ? find_extent(&extents_by_start, hint) : NULL;
+  if (e == NULL || e->cnt < cnt) {
+    e = NULL;
+    for (i = 0; i < group_cnt && e == NULL; i++)
+      e = best_fit(&groups[(first_group + i) % group_cnt], cnt);
+  }
+  if (e == NULL) {
+    lock_release(&free_map_lock);
+    return false;
   }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+
+  /* Take the sectors from the start of the extent, so that the
+     rest of it still begins where a following allocation will
+     look for it. */
+  sector = e->start;
+  remove_extent(e);
+  if (e->cnt > cnt)
+    insert_extent(sector + cnt, e->cnt - cnt);
+  slab_free(&extent_cache, e);
+
+  ASSERT(bitmap_none(free_map, sector, cnt));
+  bitmap_set_multiple(free_map, sector, cnt, true);
+  mark_dirty(sector, cnt);
+  write_dirty();
+  lock_release(&free_map_lock);
+
+  *sectorp = sector;
+  return true;
 }
 
 /* Makes CNT sectors starting at SECTOR available for use. */
 void free_map_release(block_sector_t sector, size_t cnt) {
+  lock_acquire(&free_map_lock);
   ASSERT(bitmap_all(free_map, sector, cnt));
   bitmap_set_multiple(free_map, sector, cnt, false);
-  bitmap_write(free_map, free_map_file);
+  mark_dirty(sector, cnt);
+
+  /* Index the released sectors one block group at a time. */
+  while (cnt > 0) {
+    size_t group_left = GROUP_SECTORS - sector % GROUP_SECTORS;
+    size_t piece = cnt < group_left ? cnt : group_left;
+
+    release_extent(sector, piece);
+    sector += piece;
+    cnt -= piece;
+  }
+  write_dirty();
+  lock_release(&free_map_lock);
+}
+
+/* Writes the sectors of the free map file that hold changes not
+   yet written, as one journal transaction. */
+void free_map_flush(void) {
+  /* The flusher thread may get here before the free map is
+     opened. */
+  if (free_map_file == NULL)
+    return;
+
+  journal_begin(free_map_sectors());
+  lock_acquire(&free_map_lock);
+  write_dirty();
+  lock_release(&free_map_lock);
+  journal_end();
 }
 
+/* Returns the number of sectors in the free map file.  Changing
+   the free map adds at most that many sectors to a journal
+   transaction. */
+size_t free_map_sectors(void) { return bitmap_size(dirty_map); }
+
 /* Opens the free map file and reads it from disk. */
 void free_map_open(void) {
   free_map_file = file_open(inode_open(FREE_MAP_SECTOR));
@@ -47,22 +212,221 @@ void free_map_open(void) {
     PANIC("can't open free map");
   if (!bitmap_read(free_map, free_map_file))
     PANIC("can't read free map");
+  bitmap_set_all(dirty_map, false);
+  index_free_map();
 }
 
 /* Writes the free map to disk and closes the free map file. */
-void free_map_close(void) { file_close(free_map_file); }
+void free_map_close(void) {
+  struct file* file;
+
+  free_map_flush();
+  lock_acquire(&free_map_lock);
+  file = free_map_file;
+  free_map_file = NULL;
+  lock_release(&free_map_lock);
+  file_close(file);
+}
 
 /* Creates a new free map file on disk and writes the free map to
    it. */
 void free_map_create(void) {
+  struct file* file;
+
   /* Create inode. */
   if (!inode_create(FREE_MAP_SECTOR, bitmap_file_size(free_map)))
     PANIC("free map creation failed");
 
-  /* Write bitmap to file. */
-  free_map_file = file_open(inode_open(FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  /* Write bitmap to file.  The file is not made free_map_file
+     until it has been written in full, because until then it has
+     holes, and allocating sectors for them while writing changed
+     bits would deadlock on free_map_lock.  Bits that change while
+     it is written stay marked in dirty_map. */
+  file = file_open(inode_open(FREE_MAP_SECTOR));
+  if (file == NULL)
     PANIC("can't open free map");
-  if (!bitmap_write(free_map, free_map_file))
+  if (!bitmap_write(free_map, file))
     PANIC("can't write free map");
+  free_map_file = file;
+}
+
+/* Rebuilds the extent index from the free map bitmap. */
+static void index_free_map(void) {
+  size_t sector_cnt = bitmap_size(free_map);
+  size_t start, end;
+  size_t i, j;
+
+  for (i = 0; i < group_cnt; i++)
+    for (j = 0; j < SIZE_CLASS_CNT; j++)
+      while (!list_empty(&groups[i].size_classes[j])) {
+        struct list_elem* elem = list_front(&groups[i].size_classes[j]);
+        struct extent* e = list_entry(elem, struct extent, size_elem);
+        remove_extent(e);
+        slab_free(&extent_cache, e);
+      }
+
+  /* Index each run of free sectors, split at group boundaries. */
+  for (start = 0; (start = bitmap_scan(free_map, start, 1, false)) != BITMAP_ERROR; start = end) {
+    end = bitmap_scan(free_map, start, 1, true);
+    if (end == BITMAP_ERROR)
+      end = sector_cnt;
+    if (end > ROUND_DOWN(start, GROUP_SECTORS) + GROUP_SECTORS)
+      end = ROUND_DOWN(start, GROUP_SECTORS) + GROUP_SECTORS;
+    insert_extent(start, end - start);
+  }
+}
+
+/* Returns the size class for an extent of CNT sectors. */
+static size_t size_class(size_t cnt) {
+  size_t class = 0;
+
+  while (cnt > 1 && class < SIZE_CLASS_CNT - 1) {
+    cnt >>= 1;
+    class++;
+  }
+  return class;
+}
+
+/* Adds an extent of the CNT free sectors starting at START, which
+   must lie within a single block group, to the index.  If memory
+   is short, the sectors stay free in the bitmap but cannot be
+   allocated until the free map is next opened. */
+static void insert_extent(block_sector_t start, size_t cnt) {
+  struct block_group* group = &groups[start / GROUP_SECTORS];
+  struct extent* e;
+
+  ASSERT(cnt > 0 && start % GROUP_SECTORS + cnt <= GROUP_SECTORS);
+
+  e = slab_alloc(&extent_cache);
+  if (e == NULL)
+    return;
+  e->start = start;
+  e->cnt = cnt;
+  hash_insert(&extents_by_start, &e->start_elem);
+  hash_insert(&extents_by_end, &e->end_elem);
+  list_push_front(&group->size_classes[size_class(cnt)], &e->size_elem);
+}
+
+/* Adds the CNT free sectors starting at SECTOR, which lie within a
+   single block group, to the index, merging them with the free
+   extents on either side in the same group. */
+static void release_extent(block_sector_t sector, size_t cnt) {
+  struct extent* e;
+
+  e = sector % GROUP_SECTORS != 0 ? find_extent(&extents_by_end, sector) : NULL;
+  if (e != NULL) {
+    sector = e->start;
+    cnt += e->cnt;
+    remove_extent(e);
+    slab_free(&extent_cache, e);
+  }
+  e = (sector + cnt) % GROUP_SECTORS != 0 ? find_extent(&extents_by_start, sector + cnt) : NULL;
+  if (e != NULL) {
+    cnt += e->cnt;
+    remove_extent(e);
+    slab_free(&extent_cache, e);
+  }
+  insert_extent(sector, cnt);
+}
+
+/* Removes E from the index, without freeing it. */
+static void remove_extent(struct extent* e) {
+  hash_delete(&extents_by_start, &e->start_elem);
+  hash_delete(&extents_by_end, &e->end_elem);
+  list_remove(&e->size_elem);
+}
+
+/* Returns the extent in INDEX, either extents_by_start or
+   extents_by_end, whose key is SECTOR, or a null pointer if there
+   is none. */
+static struct extent* find_extent(struct hash* index, block_sector_t sector) {
+  struct extent key;
+  struct hash_elem* e;
+
+  key.start = sector;
+  key.cnt = 0;
+  if (index == &extents_by_start) {
+    e = hash_find(index, &key.start_elem);
+    return e != NULL ? hash_entry(e, struct extent, start_elem) : NULL;
+  } else {
+    e = hash_find(index, &key.end_elem);
+    return e != NULL ? hash_entry(e, struct extent, end_elem) : NULL;
+  }
+}
+
+/* Returns the smallest extent of at least CNT sectors in GROUP
+   within the lowest size class that has one, or a null pointer if
+   no extent in GROUP is large enough. */
+static struct extent* best_fit(struct block_group* group, size_t cnt) {
+  size_t class;
+
+  for (class = size_class(cnt); class < SIZE_CLASS_CNT; class++) {
+    struct list* list = &group->size_classes[class];
+    struct extent* best = NULL;
+    struct list_elem* elem;
+
+    for (elem = list_begin(list); elem != list_end(list); elem = list_next(elem)) {
+      struct extent* e = list_entry(elem, struct extent, size_elem);
+      if (e->cnt == cnt)
+        return e;
+      if (e->cnt > cnt && (best == NULL || e->cnt < best->cnt))
+        best = e;
+    }
+    if (best != NULL)
+      return best;
+  }
+  return NULL;
+}
+
+/* Records that the bits for the CNT sectors starting at SECTOR
+   have changed and must be written to the free map file. */
+static void mark_dirty(block_sector_t sector, size_t cnt) {
+  size_t first = sector / 8 / BLOCK_SECTOR_SIZE;
+  size_t last = (sector + cnt - 1) / 8 / BLOCK_SECTOR_SIZE;
+  bitmap_set_multiple(dirty_map, first, last - first + 1, true);
+}
+
+/* Writes the sectors of the free map file marked in dirty_map,
+   if the file is open.  free_map_lock must be held.  Callers must
+   be inside a journal handle, so that beginning the nested handle
+   for the write never waits for a commit while holding the
+   lock.  The free map file has no holes, so writing it never
+   allocates sectors, which would deadlock on free_map_lock. */
+static void write_dirty(void) {
+  size_t i;
+
+  ASSERT(lock_held_by_current_thread(&free_map_lock));
+
+  if (free_map_file != NULL)
+    for (i = 0; (i = bitmap_scan(dirty_map, i, 1, true)) != BITMAP_ERROR; i++)
+      if (bitmap_write_part(free_map, free_map_file, i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE))
+        bitmap_reset(dirty_map, i);
+}
+
+/* Returns a hash value for the first sector of the extent
+   containing E. */
+static unsigned start_hash(const struct hash_elem* e, void* aux UNUSED) {
+  return hash_int(hash_entry(e, struct extent, start_elem)->start);
+}
+
+/* Returns true if extent A, containing START_ELEM A_, starts
+   before extent B. */
+static bool start_less(const struct hash_elem* a_, const struct hash_elem* b_, void* aux UNUSED) {
+  return (hash_entry(a_, struct extent, start_elem)->start <
+          hash_entry(b_, struct extent, start_elem)->start);
+}
+
+/* Returns a hash value for the sector just past the end of the
+   extent containing E. */
+static unsigned end_hash(const struct hash_elem* e_, void* aux UNUSED) {
+  const struct extent* e = hash_entry(e_, struct extent, end_elem);
+  return hash_int(e->start + e->cnt);
+}
+
+/* Returns true if extent A, containing END_ELEM A_, ends before
+   extent B. */
+static bool end_less(const struct hash_elem* a_, const struct hash_elem* b_, void* aux UNUSED) {
+  const struct extent* a = hash_entry(a_, struct extent, end_elem);
+  const struct extent* b = hash_entry(b_, struct extent, end_elem);
+  return a->start + a->cnt < b->start + b->cnt;
 }
@@ -10,8 +10,11 @@ void free_map_read(void);
 void free_map_create(void);
 void free_map_open(void);
 void free_map_close(void);
+void free_map_flush(void);
+size_t free_map_sectors(void);
 
 bool free_map_allocate(size_t, block_sector_t*);
+bool free_map_allocate_near(size_t, block_sector_t hint, block_sector_t*);
 void free_map_release(block_sector_t, size_t);
 
 #endif /* filesys/free-map.h */
@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <dirent.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,15 +14,17 @@
 
 /* List files in the root directory. */
 void fsutil_ls(char** argv UNUSED) {
+  struct dirent entries[16];
   struct dir* dir;
-  char name[NAME_MAX + 1];
+  size_t cnt, i;
 
   printf("Files in the root directory:\n");
   dir = dir_open_root();
   if (dir == NULL)
     PANIC("root dir open failed");
-  while (dir_readdir(dir, name))
-    printf("%s\n", name);
+  while ((cnt = dir_getdents(dir, entries, sizeof entries / sizeof *entries)) > 0)
+    for (i = 0; i < cnt; i++)
+      printf("%s\n", entries[i].name);
   dir_close(dir);
   printf("End of listing.\n");
 }
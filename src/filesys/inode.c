@@ -1,56 +1,383 @@
 #include "filesys/inode.h"
-#include <list.h>
 #include <debug.h>
+#include <hash.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of sector pointers held directly in an inode, and
+   number of pointers that fit in one index block. */
+#define DIRECT_CNT 123
+#define PTRS_PER_SECTOR ((size_t)(BLOCK_SECTOR_SIZE / sizeof(block_sector_t)))
+
+/* Maximum number of data sectors in a file: the direct
+   pointers, one indirect block, and one doubly indirect block. */
+#define MAX_SECTORS (DIRECT_CNT + PTRS_PER_SECTOR + PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+
+/* Number of chunks in an inode's block map: one for the indirect
+   block, and one for each index block under the doubly indirect
+   block. */
+#define MAP_CHUNKS (1 + PTRS_PER_SECTOR)
+
+/* Number of bytes of data that can be stored in the inode
+   itself, in place of its sector pointers. */
+#define INLINE_MAX ((DIRECT_CNT + 2) * sizeof(block_sector_t))
+
+/* Inode flags. */
+#define INODE_INLINE 0x1 /* Data is in inline_data, not in sectors. */
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   Data sectors are found through a multi-level index.  The
+   first DIRECT_CNT sectors are listed in the inode itself, the
+   next PTRS_PER_SECTOR in the indirect block, and the rest in
+   the index blocks listed by the doubly indirect block.  A
+   pointer of 0 means that no sector has been allocated there
+   (sector 0 always holds the free map inode, so it is never a
+   data or index sector).  A file grows by filling in pointers,
+   so existing data never moves.
+
+   Files may be sparse.  Extending a file only changes its length,
+   and a data sector is allocated only when some part of it is
+   first written.  Until then, the missing sector is a hole, which
+   reads as zeros.
+
+   A file of at most INLINE_MAX bytes is instead stored in the
+   inode itself, in the space of the pointers, so that it needs
+   neither a data sector nor a read beyond the inode.  Such an
+   inode has INODE_INLINE set.  Once the file grows beyond
+   INLINE_MAX bytes, its data moves to a data sector for good. */
 struct inode_disk {
-  block_sector_t start; /* First data sector. */
-  off_t length;         /* File size in bytes. */
-  unsigned magic;       /* Magic number. */
-  uint32_t unused[125]; /* Not used. */
+  off_t length;   /* File size in bytes. */
+  unsigned magic; /* Magic number. */
+  union {
+    struct {
+      block_sector_t direct[DIRECT_CNT]; /* Direct data sectors. */
+      block_sector_t indirect;           /* Indirect index block. */
+      block_sector_t doubly_indirect;    /* Doubly indirect index block. */
+    };
+    uint8_t inline_data[INLINE_MAX]; /* Data, if INODE_INLINE. */
+  };
+  uint32_t flags; /* INODE_* flags. */
 };
 
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
 static inline size_t bytes_to_sectors(off_t size) { return DIV_ROUND_UP(size, BLOCK_SECTOR_SIZE); }
 
-/* In-memory inode. */
+/* In-memory inode.
+
+   DATA is protected by RW_LOCK.  Reads hold it as readers, for
+   the whole read, so that any number of threads may read a file
+   at once.  Writes within existing data sectors hold it as
+   readers only while finding the sector, and then copy into the
+   buffer cache, whose entries have locks of their own.  Changes
+   to DATA itself, that is, filling in holes, extending the file,
+   and moving inline data out, hold it as writers, which
+   serializes extension without blocking in-place writes for
+   longer than each change.  A writer must begin its journal
+   handle before acquiring RW_LOCK, because beginning a handle may
+   wait for a commit.
+
+   The block map changes even under a read lock, as it is filled
+   in lazily, so it has a lock of its own. */
 struct inode {
-  struct list_elem elem;  /* Element in inode list. */
-  block_sector_t sector;  /* Sector number of disk location. */
-  int open_cnt;           /* Number of openers. */
-  bool removed;           /* True if deleted, false otherwise. */
-  int deny_write_cnt;     /* 0: writes ok, >0: deny writes. */
-  struct inode_disk data; /* Inode content. */
+  struct hash_elem elem;       /* Element in open_inodes. */
+  block_sector_t sector;       /* Sector number of disk location. */
+  int open_cnt;                /* Number of openers. */
+  bool ready;                  /* Has DATA been read from disk? */
+  struct condition ready_cond; /* Signaled when READY is set. */
+  bool removed;                /* True if deleted, false otherwise. */
+  int deny_write_cnt;          /* 0: writes ok, >0: deny writes. */
+  struct rw_lock rw_lock;      /* Protects DATA. */
+  struct lock dir_lock;        /* Serializes changes to a directory. */
+  struct inode_disk data;      /* Inode content. */
+
+  /* Block map: copies of the index blocks that hold the file's
+     data sectors beyond the direct ones, one chunk per index
+     block, each read on first use, so that lookups in hot files
+     do not go through the index.  Chunk 0 copies the indirect
+     block, and chunk K copies the K'th block under the doubly
+     indirect block.  A null chunk has not been read yet. */
+  struct lock map_lock; /* Protects the member below. */
+  block_sector_t** map; /* MAP_CHUNKS chunks, or null. */
 };
 
+/* Returns entry IDX of the index block in SECTOR. */
+static block_sector_t index_get(block_sector_t sector, size_t idx) {
+  block_sector_t entry;
+  cache_read(sector, &entry, idx * sizeof entry, sizeof entry);
+  return entry;
+}
+
+/* Sets entry IDX of the index block in SECTOR to ENTRY. */
+static void index_set(block_sector_t sector, size_t idx, block_sector_t entry) {
+  cache_write(sector, &entry, idx * sizeof entry, sizeof entry);
+}
+
+/* Returns the sector that holds data sector IDX of the file
+   described by DISK, or 0 if none has been allocated. */
+static block_sector_t lookup_sector(const struct inode_disk* disk, size_t idx) {
+  block_sector_t index;
+
+  if (idx < DIRECT_CNT)
+    return disk->direct[idx];
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    return disk->indirect != 0 ? index_get(disk->indirect, idx) : 0;
+  idx -= PTRS_PER_SECTOR;
+
+  if (disk->doubly_indirect == 0)
+    return 0;
+  index = index_get(disk->doubly_indirect, idx / PTRS_PER_SECTOR);
+  return index != 0 ? index_get(index, idx % PTRS_PER_SECTOR) : 0;
+}
+
+/* Allocates a sector, preferably *HINT, fills it with zeros,
+   and stores it into *SECTOR.  Advances *HINT to the following
+   sector, so that consecutive allocations tend to be adjacent on
+   disk.  Returns false if the disk is full.
+   The zeros stay out of the running transaction, which would
+   otherwise fill up with the data sectors of a growing file.  A
+   new index block joins it once an entry is set in it. */
+static bool allocate_zeroed(block_sector_t* sector, block_sector_t* hint) {
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (!free_map_allocate_near(1, *hint, sector))
+    return false;
+  cache_write_data(*sector, zeros, 0, BLOCK_SECTOR_SIZE);
+  *hint = *sector + 1;
+  return true;
+}
+
+/* Stores *SLOT into *SECTOR, first allocating a zeroed sector
+   near *HINT for *SLOT if it is 0.  Returns false if the disk is
+   full. */
+static bool fill_slot(block_sector_t* slot, block_sector_t* sector, block_sector_t* hint) {
+  block_sector_t new_sector;
+
+  if (*slot == 0) {
+    if (!allocate_zeroed(&new_sector, hint))
+      return false;
+    *slot = new_sector;
+  }
+  *sector = *slot;
+  return true;
+}
+
+/* Like fill_slot(), for entry IDX of the index block in INDEX. */
+static bool fill_entry(block_sector_t index, size_t idx, block_sector_t* sector,
+                       block_sector_t* hint) {
+  block_sector_t entry = index_get(index, idx);
+
+  if (entry == 0) {
+    if (!allocate_zeroed(&entry, hint))
+      return false;
+    index_set(index, idx, entry);
+  }
+  *sector = entry;
+  return true;
+}
+
+/* Stores into *SECTOR the sector that holds data sector IDX of
+   the file described by DISK, allocating it and any index blocks
+   on the way to it if they do not exist yet.  New sectors are
+   zeroed and allocated near *HINT, which is advanced past them.
+   Returns false if the disk is full; index blocks allocated
+   before that point stay linked into DISK. */
+static bool allocate_sector(struct inode_disk* disk, size_t idx, block_sector_t* sector,
+                            block_sector_t* hint) {
+  block_sector_t index;
+
+  ASSERT(idx < MAX_SECTORS);
+
+  if (idx < DIRECT_CNT)
+    return fill_slot(&disk->direct[idx], sector, hint);
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    return fill_slot(&disk->indirect, &index, hint) && fill_entry(index, idx, sector, hint);
+  idx -= PTRS_PER_SECTOR;
+
+  return (fill_slot(&disk->doubly_indirect, &index, hint) &&
+          fill_entry(index, idx / PTRS_PER_SECTOR, &index, hint) &&
+          fill_entry(index, idx % PTRS_PER_SECTOR, sector, hint));
+}
+
+/* Releases the index block in SECTOR, which has LEVELS levels of
+   index blocks beneath it, and every sector it points to.  With
+   LEVELS 0, SECTOR is a data sector.  Does nothing if SECTOR is
+   0. */
+static void release_tree(block_sector_t sector, int levels) {
+  size_t i;
+
+  if (sector == 0)
+    return;
+  if (levels > 0)
+    for (i = 0; i < PTRS_PER_SECTOR; i++)
+      release_tree(index_get(sector, i), levels - 1);
+  free_map_release(sector, 1);
+}
+
+/* Releases all of the data and index sectors of the file
+   described by DISK. */
+static void deallocate(const struct inode_disk* disk) {
+  size_t i;
+
+  if (disk->flags & INODE_INLINE)
+    return;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    release_tree(disk->direct[i], 0);
+  release_tree(disk->indirect, 1);
+  release_tree(disk->doubly_indirect, 2);
+}
+
+/* Reads chunk CHUNK of INODE's block map, unless the index block
+   it copies does not exist yet.  The index block is read without
+   holding map_lock, so that other lookups in the map need not
+   wait for the I/O; if another thread reads the same chunk
+   meanwhile, its copy is kept.  If memory is short, the chunk is
+   left unread, and lookups in it go through the index blocks
+   instead.  INODE's rw_lock must be held. */
+static void fill_chunk(struct inode* inode, size_t chunk) {
+  const struct inode_disk* disk = &inode->data;
+  block_sector_t index;
+  block_sector_t* entries;
+
+  if (chunk == 0)
+    index = disk->indirect;
+  else
+    index = disk->doubly_indirect != 0 ? index_get(disk->doubly_indirect, chunk - 1) : 0;
+  if (index == 0)
+    return;
+
+  entries = malloc(BLOCK_SECTOR_SIZE);
+  if (entries == NULL)
+    return;
+  cache_read(index, entries, 0, BLOCK_SECTOR_SIZE);
+
+  lock_acquire(&inode->map_lock);
+  if (inode->map == NULL)
+    inode->map = calloc(MAP_CHUNKS, sizeof *inode->map);
+  if (inode->map != NULL && inode->map[chunk] == NULL) {
+    inode->map[chunk] = entries;
+    entries = NULL;
+  }
+  lock_release(&inode->map_lock);
+  free(entries);
+}
+
+/* Returns the entry for data sector IDX, which must not be a
+   direct sector, in INODE's block map, or -1 if its chunk has not
+   been read. */
+static block_sector_t map_lookup(struct inode* inode, size_t idx) {
+  block_sector_t sector = -1;
+
+  idx -= DIRECT_CNT;
+  lock_acquire(&inode->map_lock);
+  if (inode->map != NULL && inode->map[idx / PTRS_PER_SECTOR] != NULL)
+    sector = inode->map[idx / PTRS_PER_SECTOR][idx % PTRS_PER_SECTOR];
+  lock_release(&inode->map_lock);
+  return sector;
+}
+
+/* Returns the block device sector that holds data sector IDX of
+   INODE, or 0 if that sector is a hole.  Only the chunk of the
+   block map that covers IDX is read, so the first lookup costs
+   at most two index block reads, however large the file.
+   INODE's rw_lock must be held. */
+static block_sector_t index_to_sector(struct inode* inode, size_t idx) {
+  block_sector_t sector;
+
+  if (idx < DIRECT_CNT)
+    return inode->data.direct[idx];
+
+  sector = map_lookup(inode, idx);
+  if (sector == (block_sector_t)-1) {
+    fill_chunk(inode, (idx - DIRECT_CNT) / PTRS_PER_SECTOR);
+    sector = map_lookup(inode, idx);
+  }
+  return sector != (block_sector_t)-1 ? sector : lookup_sector(&inode->data, idx);
+}
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
+   within INODE, or 0 if POS lies in a hole.
    Returns -1 if INODE does not contain data for a byte at offset
    POS. */
-static block_sector_t byte_to_sector(const struct inode* inode, off_t pos) {
+static block_sector_t byte_to_sector(struct inode* inode, off_t pos) {
   ASSERT(inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  else
+  if (pos >= inode->data.length)
     return -1;
+  return index_to_sector(inode, pos / BLOCK_SECTOR_SIZE);
+}
+
+/* Returns the block device sector that holds data sector IDX of
+   INODE, first allocating a zeroed sector if it is a hole.  The
+   new sector is placed after the file's previous sector, or after
+   the inode for the first one, if possible.  Returns 0 if the disk
+   is full.  INODE's rw_lock must be held as a writer, inside a
+   journal handle. */
+static block_sector_t allocate_hole(struct inode* inode, size_t idx) {
+  block_sector_t sector = index_to_sector(inode, idx);
+  block_sector_t hint;
+  bool success;
+
+  if (sector != 0)
+    return sector;
+
+  hint = idx > 0 ? index_to_sector(inode, idx - 1) : 0;
+  hint = (hint != 0 ? hint : inode->sector) + 1;
+  success = allocate_sector(&inode->data, idx, &sector, &hint);
+
+  /* Even on failure, new index blocks may have been linked into
+     the inode, which must not be lost. */
+  cache_write(inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  if (!success)
+    return 0;
+  if (idx >= DIRECT_CNT) {
+    size_t chunk = (idx - DIRECT_CNT) / PTRS_PER_SECTOR;
+
+    lock_acquire(&inode->map_lock);
+    if (inode->map != NULL && inode->map[chunk] != NULL)
+      inode->map[chunk][(idx - DIRECT_CNT) % PTRS_PER_SECTOR] = sector;
+    lock_release(&inode->map_lock);
+  }
+  return sector;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Open inodes, hashed by sector, so that opening a single inode
+   twice returns the same `struct inode'. */
+static struct hash open_inodes;
+
+/* Protects open_inodes and the open_cnt and ready members of
+   every open inode. */
+static struct lock open_inodes_lock;
+
+/* Cache of struct inode. */
+static struct slab_cache inode_cache;
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
 
 /* Initializes the inode module. */
-void inode_init(void) { list_init(&open_inodes); }
+void inode_init(void) {
+  if (!hash_init(&open_inodes, inode_hash, inode_less, NULL))
+    PANIC("can't create open inode table");
+  lock_init(&open_inodes_lock);
+  slab_cache_init(&inode_cache, "inode", sizeof(struct inode), 0, NULL);
+}
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
@@ -68,61 +395,90 @@ bool inode_create(block_sector_t sector, off_t length) {
   ASSERT(sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
   disk_inode = calloc(1, sizeof *disk_inode);
-  if (disk_inode != NULL) {
-    size_t sectors = bytes_to_sectors(length);
+  if (disk_inode != NULL && bytes_to_sectors(length) <= MAX_SECTORS) {
+    /* The data, all zeros, either fits in the inode or is one big
+       hole, so nothing needs to be allocated or written besides
+       the inode. */
     disk_inode->length = length;
     disk_inode->magic = INODE_MAGIC;
-    if (free_map_allocate(sectors, &disk_inode->start)) {
-      block_write(fs_device, sector, disk_inode);
-      if (sectors > 0) {
-        static char zeros[BLOCK_SECTOR_SIZE];
-        size_t i;
-
-        for (i = 0; i < sectors; i++)
-          block_write(fs_device, disk_inode->start + i, zeros);
-      }
-      success = true;
-    }
-    free(disk_inode);
+    if (length <= (off_t)INLINE_MAX)
+      disk_inode->flags = INODE_INLINE;
+    cache_write(sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+    success = true;
   }
+  free(disk_inode);
   return success;
 }
 
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
-   Returns a null pointer if memory allocation fails. */
+   Returns a null pointer if memory allocation fails.
+
+   An inode that is not open yet is entered into open_inodes
+   before it is read, marked as not ready, so that
+   open_inodes_lock need not be held across the read.  Threads
+   that open the same inode meanwhile wait for it to become
+   ready. */
 struct inode* inode_open(block_sector_t sector) {
-  struct list_elem* e;
+  struct inode key;
   struct inode* inode;
-
-  /* Check whether this inode is already open. */
-  for (e = list_begin(&open_inodes); e != list_end(&open_inodes); e = list_next(e)) {
-    inode = list_entry(e, struct inode, elem);
-    if (inode->sector == sector) {
-      inode_reopen(inode);
-      return inode;
+  struct inode* new = NULL;
+  struct hash_elem* e;
+
+  key.sector = sector;
+  lock_acquire(&open_inodes_lock);
+  e = hash_find(&open_inodes, &key.elem);
+  if (e == NULL) {
+    lock_release(&open_inodes_lock);
+
+    new = slab_alloc(&inode_cache);
+    if (new == NULL)
+      return NULL;
+    new->sector = sector;
+    new->open_cnt = 1;
+    new->ready = false;
+    cond_init(&new->ready_cond);
+    new->deny_write_cnt = 0;
+    new->removed = false;
+    rw_lock_init(&new->rw_lock);
+    lock_init(&new->dir_lock);
+    lock_init(&new->map_lock);
+    new->map = NULL;
+
+    /* Another thread may have opened SECTOR while the lock was
+       released. */
+    lock_acquire(&open_inodes_lock);
+    e = hash_insert(&open_inodes, &new->elem);
+    if (e == NULL) {
+      lock_release(&open_inodes_lock);
+      cache_read(sector, &new->data, 0, BLOCK_SECTOR_SIZE);
+
+      lock_acquire(&open_inodes_lock);
+      new->ready = true;
+      cond_broadcast(&new->ready_cond, &open_inodes_lock);
+      lock_release(&open_inodes_lock);
+      return new;
     }
   }
 
-  /* Allocate memory. */
-  inode = malloc(sizeof *inode);
-  if (inode == NULL)
-    return NULL;
-
-  /* Initialize. */
-  list_push_front(&open_inodes, &inode->elem);
-  inode->sector = sector;
-  inode->open_cnt = 1;
-  inode->deny_write_cnt = 0;
-  inode->removed = false;
-  block_read(fs_device, inode->sector, &inode->data);
+  inode = hash_entry(e, struct inode, elem);
+  inode->open_cnt++;
+  while (!inode->ready)
+    cond_wait(&inode->ready_cond, &open_inodes_lock);
+  lock_release(&open_inodes_lock);
+
+  if (new != NULL)
+    slab_free(&inode_cache, new);
   return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode* inode_reopen(struct inode* inode) {
-  if (inode != NULL)
+  if (inode != NULL) {
+    lock_acquire(&open_inodes_lock);
     inode->open_cnt++;
+    lock_release(&open_inodes_lock);
+  }
   return inode;
 }
 
@@ -133,25 +489,47 @@ block_sector_t inode_get_inumber(const struct inode* inode) { return inode->sect
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
 void inode_close(struct inode* inode) {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0) {
-    /* Remove from inode list and release lock. */
-    list_remove(&inode->elem);
+  lock_acquire(&open_inodes_lock);
+  last = --inode->open_cnt == 0;
+  if (last)
+    hash_delete(&open_inodes, &inode->elem);
+  lock_release(&open_inodes_lock);
 
+  /* Release resources if this was the last opener. */
+  if (last) {
     /* Deallocate blocks if removed. */
     if (inode->removed) {
+      journal_begin(free_map_sectors());
       free_map_release(inode->sector, 1);
-      free_map_release(inode->data.start, bytes_to_sectors(inode->data.length));
+      deallocate(&inode->data);
+      journal_end();
     }
 
-    free(inode);
+    if (inode->map != NULL) {
+      size_t i;
+
+      for (i = 0; i < MAP_CHUNKS; i++)
+        free(inode->map[i]);
+      free(inode->map);
+    }
+    slab_free(&inode_cache, inode);
   }
 }
 
+/* Acquires INODE's directory lock, which serializes changes to
+   the directory stored in INODE.  Must be acquired after
+   beginning the journal handle for the change. */
+void inode_dir_lock(struct inode* inode) { lock_acquire(&inode->dir_lock); }
+
+/* Releases INODE's directory lock. */
+void inode_dir_unlock(struct inode* inode) { lock_release(&inode->dir_lock); }
+
 /* Marks INODE to be deleted when it is closed by the last caller who
    has it open. */
 void inode_remove(struct inode* inode) {
@@ -165,7 +543,19 @@ void inode_remove(struct inode* inode) {
 off_t inode_read_at(struct inode* inode, void* buffer_, off_t size, off_t offset) {
   uint8_t* buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t* bounce = NULL;
+
+  /* Only a read too large to stay in the cache bypasses it. */
+  bool direct = size > (off_t)(CACHE_SIZE * BLOCK_SECTOR_SIZE);
+
+  rw_lock_acquire(&inode->rw_lock, RW_READER);
+  if (inode->data.flags & INODE_INLINE) {
+    if (offset < inode_length(inode)) {
+      bytes_read = size < inode_length(inode) - offset ? size : inode_length(inode) - offset;
+      memcpy(buffer, inode->data.inline_data + offset, bytes_read);
+    }
+    rw_lock_release(&inode->rw_lock, RW_READER);
+    return bytes_read;
+  }
 
   while (size > 0) {
     /* Disk sector to read, starting byte offset within sector. */
@@ -182,87 +572,166 @@ off_t inode_read_at(struct inode* inode, void* buffer_, off_t size, off_t offset
     if (chunk_size <= 0)
       break;
 
-    if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
-      /* Read full sector directly into caller's buffer. */
-      block_read(fs_device, sector_idx, buffer + bytes_read);
-    } else {
-      /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-      if (bounce == NULL) {
-        bounce = malloc(BLOCK_SECTOR_SIZE);
-        if (bounce == NULL)
-          break;
-      }
-      block_read(fs_device, sector_idx, bounce);
-      memcpy(buffer + bytes_read, bounce + sector_ofs, chunk_size);
-    }
+    /* Copy the chunk out of the buffer cache, or zeros for a
+       hole.  A whole sector of a large read may come straight from
+       the device. */
+    if (sector_idx != 0 && direct && chunk_size == BLOCK_SECTOR_SIZE)
+      cache_read_sector(sector_idx, buffer + bytes_read);
+    else if (sector_idx != 0)
+      cache_read(sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+    else
+      memset(buffer + bytes_read, 0, chunk_size);
 
     /* Advance. */
     size -= chunk_size;
     offset += chunk_size;
     bytes_read += chunk_size;
   }
-  free(bounce);
+  rw_lock_release(&inode->rw_lock, RW_READER);
 
   return bytes_read;
 }
 
+/* Starts reading the sectors of INODE that hold the SIZE bytes
+   starting at OFFSET into the buffer cache in the background.
+   Bytes beyond end of file are ignored. */
+void inode_read_ahead(struct inode* inode, off_t offset, off_t size) {
+  off_t end = offset + size;
+
+  rw_lock_acquire(&inode->rw_lock, RW_READER);
+  if (end > inode_length(inode))
+    end = inode_length(inode);
+  if (!(inode->data.flags & INODE_INLINE))
+    for (offset = ROUND_DOWN(offset, BLOCK_SECTOR_SIZE); offset < end;
+         offset += BLOCK_SECTOR_SIZE) {
+      block_sector_t sector = byte_to_sector(inode, offset);
+      if (sector != 0)
+        cache_read_ahead(sector);
+    }
+  rw_lock_release(&inode->rw_lock, RW_READER);
+}
+
+/* Moves the data of INODE, which is stored inline, into a data
+   sector, so that the file can grow beyond INLINE_MAX bytes.
+   Returns true if successful, false if memory or disk allocation
+   fails, in which case INODE is unchanged. */
+static bool move_inline_data(struct inode* inode) {
+  struct inode_disk* disk = &inode->data;
+  block_sector_t sector, hint = inode->sector + 1;
+  uint8_t* data;
+
+  data = malloc(INLINE_MAX);
+  if (data == NULL)
+    return false;
+  memcpy(data, disk->inline_data, INLINE_MAX);
+
+  memset(disk->inline_data, 0, INLINE_MAX);
+  disk->flags &= ~INODE_INLINE;
+  if (disk->length > 0) {
+    if (!allocate_sector(disk, 0, &sector, &hint)) {
+      memcpy(disk->inline_data, data, INLINE_MAX);
+      disk->flags |= INODE_INLINE;
+      free(data);
+      return false;
+    }
+    /* Until now, the data was part of the journaled inode, so it
+       is journaled once more on its way to the data sector. */
+    cache_write(sector, data, 0, disk->length);
+  }
+  cache_write(inode->sector, disk, 0, BLOCK_SECTOR_SIZE);
+  free(data);
+  return true;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up or the file would grow
+   too large.
+   A write past end of file extends the inode.  Any gap between
+   the old end of file and OFFSET becomes a hole. */
 off_t inode_write_at(struct inode* inode, const void* buffer_, off_t size, off_t offset) {
   const uint8_t* buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t* bounce = NULL;
 
   if (inode->deny_write_cnt)
     return 0;
 
+  /* An inode never becomes inline again, so only a write that
+     sees INODE_INLINE needs to check it again under the lock. */
+  if (inode->data.flags & INODE_INLINE) {
+    bool done = false;
+
+    /* Inline data lives in the inode, so it is journaled like the
+       rest of the inode. */
+    journal_begin(INODE_WRITE_CREDITS);
+    rw_lock_acquire(&inode->rw_lock, RW_WRITER);
+    if (inode->data.flags & INODE_INLINE) {
+      if (offset + size <= (off_t)INLINE_MAX) {
+        memcpy(inode->data.inline_data + offset, buffer, size);
+        if (offset + size > inode_length(inode))
+          inode->data.length = offset + size;
+        cache_write(inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+        bytes_written = size;
+        done = true;
+      } else
+        done = !move_inline_data(inode);
+    }
+    rw_lock_release(&inode->rw_lock, RW_WRITER);
+    journal_end();
+    if (done)
+      return bytes_written;
+  }
+
+  /* Limit the write to the maximum file size. */
+  if (offset >= (off_t)(MAX_SECTORS * BLOCK_SECTOR_SIZE))
+    return 0;
+  if (size > (off_t)(MAX_SECTORS * BLOCK_SECTOR_SIZE) - offset)
+    size = MAX_SECTORS * BLOCK_SECTOR_SIZE - offset;
+
   while (size > 0) {
     /* Sector to write, starting byte offset within sector. */
-    block_sector_t sector_idx = byte_to_sector(inode, offset);
+    block_sector_t sector_idx;
     int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-    /* Bytes left in inode, bytes left in sector, lesser of the two. */
-    off_t inode_left = inode_length(inode) - offset;
+    /* Bytes left in sector. */
     int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-    int min_left = inode_left < sector_left ? inode_left : sector_left;
 
     /* Number of bytes to actually write into this sector. */
-    int chunk_size = size < min_left ? size : min_left;
-    if (chunk_size <= 0)
-      break;
-
-    if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
-      /* Write full sector directly to disk. */
-      block_write(fs_device, sector_idx, buffer + bytes_written);
-    } else {
-      /* We need a bounce buffer. */
-      if (bounce == NULL) {
-        bounce = malloc(BLOCK_SECTOR_SIZE);
-        if (bounce == NULL)
-          break;
-      }
-
-      /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-      if (sector_ofs > 0 || chunk_size < sector_left)
-        block_read(fs_device, sector_idx, bounce);
-      else
-        memset(bounce, 0, BLOCK_SECTOR_SIZE);
-      memcpy(bounce + sector_ofs, buffer + bytes_written, chunk_size);
-      block_write(fs_device, sector_idx, bounce);
+    int chunk_size = size < sector_left ? size : sector_left;
+
+    /* Holes are filled in as they are written. */
+    rw_lock_acquire(&inode->rw_lock, RW_READER);
+    sector_idx = index_to_sector(inode, offset / BLOCK_SECTOR_SIZE);
+    rw_lock_release(&inode->rw_lock, RW_READER);
+    if (sector_idx == 0) {
+      journal_begin(INODE_WRITE_CREDITS);
+      rw_lock_acquire(&inode->rw_lock, RW_WRITER);
+      sector_idx = allocate_hole(inode, offset / BLOCK_SECTOR_SIZE);
+      rw_lock_release(&inode->rw_lock, RW_WRITER);
+      journal_end();
+      if (sector_idx == 0)
+        break;
     }
 
+    /* Copy the chunk into the buffer cache. */
+    cache_write(sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
+
     /* Advance. */
     size -= chunk_size;
     offset += chunk_size;
     bytes_written += chunk_size;
   }
-  free(bounce);
+
+  if (offset > inode_length(inode)) {
+    journal_begin(1);
+    rw_lock_acquire(&inode->rw_lock, RW_WRITER);
+    if (offset > inode_length(inode)) {
+      inode->data.length = offset;
+      cache_write(inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+    }
+    rw_lock_release(&inode->rw_lock, RW_WRITER);
+    journal_end();
+  }
 
   return bytes_written;
 }
@@ -285,3 +754,14 @@ void inode_allow_write(struct inode* inode) {
 
 /* Returns the length, in bytes, of INODE's data. */
 off_t inode_length(const struct inode* inode) { return inode->data.length; }
+
+/* Returns a hash value for the inode containing E. */
+static unsigned inode_hash(const struct hash_elem* e, void* aux UNUSED) {
+  return hash_int(hash_entry(e, struct inode, elem)->sector);
+}
+
+/* Returns true if the inode containing A precedes the one
+   containing B. */
+static bool inode_less(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED) {
+  return hash_entry(a, struct inode, elem)->sector < hash_entry(b, struct inode, elem)->sector;
+}
@@ -7,6 +7,13 @@
 
 struct bitmap;
 
+/* Most sectors that an inode_write_at() call within a single
+   sector adds to a journal transaction: the sector written, the
+   inode, two new index blocks, and the free map sectors that
+   record the allocation of a data sector and those index
+   blocks. */
+#define INODE_WRITE_CREDITS 7
+
 void inode_init(void);
 bool inode_create(block_sector_t, off_t);
 struct inode* inode_open(block_sector_t);
@@ -14,7 +21,10 @@ struct inode* inode_reopen(struct inode*);
 block_sector_t inode_get_inumber(const struct inode*);
 void inode_close(struct inode*);
 void inode_remove(struct inode*);
+void inode_dir_lock(struct inode*);
+void inode_dir_unlock(struct inode*);
 off_t inode_read_at(struct inode*, void*, off_t size, off_t offset);
+void inode_read_ahead(struct inode*, off_t offset, off_t size);
 off_t inode_write_at(struct inode*, const void*, off_t size, off_t offset);
 void inode_deny_write(struct inode*);
 void inode_allow_write(struct inode*);
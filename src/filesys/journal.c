@@ -0,0 +1,343 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Metadata journal.
+
+   Changes to file system metadata (inodes, index blocks,
+   directories, and the free map) are made in the buffer cache
+   inside transaction handles, bracketed by journal_begin() and
+   journal_end().  Every sector written inside a handle joins the
+   running transaction, and the cache does not write it in place
+   until the transaction has been committed to the journal.
+
+   The running transaction collects the changes of many
+   operations.  It is committed, all at once, when the flusher
+   runs, when the file system is synced or shut down, or when it
+   grows to TXN_SOFT_MAX sectors.  Committing waits for the
+   handles in progress to end, while new ones wait for the commit.
+
+   Each handle states, when it begins, the most sectors it can
+   add to the transaction, its credits.  The credits of the
+   handles in progress are reserved, and a handle begins only if
+   its credits fit in the transaction alongside the sectors
+   already in it and the reserved credits; otherwise the running
+   transaction is committed first.  Thus a transaction never
+   grows beyond TXN_MAX sectors, however many handles add to it
+   at once.
+
+   The journal occupies JOURNAL_SECTORS sectors starting at
+   JOURNAL_SECTOR: a header sector, followed by a circular log.  A
+   transaction appears in the log as a descriptor sector that
+   lists the home sectors of the transaction's sectors, then a
+   copy of each of those sectors, then a commit sector.  The
+   header records where in the log the oldest transaction that
+   may not yet be in place begins.  When a commit leaves too
+   little room in the log for another transaction, the cache is
+   flushed, which puts every committed sector in place, and the
+   log is emptied.  This happens only once the committed sectors
+   have left the journal, so that none is still held back from
+   being written in place.
+
+   At startup, journal_init() replays every complete transaction
+   found in the log, in order, by copying its sectors to their
+   home locations.  A transaction whose commit sector never made
+   it to disk is ignored. */
+
+/* Number of sectors in the log. */
+#define LOG_SECTORS (JOURNAL_SECTORS - 1)
+
+/* A handle that begins while the running transaction has this
+   many sectors first waits for it to be committed.  A
+   transaction never exceeds TXN_MAX sectors. */
+#define TXN_SOFT_MAX 24
+#define TXN_MAX 48
+
+/* Magic numbers. */
+#define HEADER_MAGIC 0x4a524e4c     /* Journal header. */
+#define DESCRIPTOR_MAGIC 0x4a444553 /* Transaction descriptor. */
+#define COMMIT_MAGIC 0x4a434d54     /* Transaction commit. */
+
+/* Journal header, in sector JOURNAL_SECTOR. */
+struct journal_header {
+  uint32_t magic;       /* HEADER_MAGIC. */
+  uint32_t tail;        /* Log position of oldest transaction. */
+  uint32_t seq;         /* Sequence number of oldest transaction. */
+  uint32_t unused[125]; /* Not used. */
+};
+
+/* Transaction descriptor or commit sector. */
+struct journal_record {
+  uint32_t magic;                  /* DESCRIPTOR_MAGIC or COMMIT_MAGIC. */
+  uint32_t seq;                    /* Sequence number. */
+  uint32_t cnt;                    /* Number of sectors. */
+  block_sector_t sectors[TXN_MAX]; /* Home sectors, in descriptors. */
+  uint32_t unused[125 - TXN_MAX];  /* Not used. */
+};
+
+static struct lock journal_lock;      /* Protects everything below. */
+static struct condition journal_cond; /* Handles ended or a commit finished. */
+static int handle_cnt;                /* Number of handles in progress. */
+static size_t reserved;               /* Unused credits of handles in progress. */
+static bool committing;               /* Is a commit in progress? */
+
+/* The running transaction. */
+static block_sector_t txn_sectors[TXN_MAX];
+static size_t txn_cnt;
+
+/* The log.  HEAD and TAIL are positions in the log that count
+   sectors written since it was last emptied, starting from where
+   it was emptied, so the log holds HEAD - TAIL sectors. */
+static uint32_t head, tail;
+static uint32_t head_seq; /* Sequence number of next transaction. */
+static uint32_t tail_seq; /* Sequence number of transaction at TAIL. */
+
+static void* io_buffer; /* BLOCK_SECTOR_SIZE bytes for I/O. */
+
+static void replay(void);
+static void commit(void);
+static void checkpoint(void);
+static void write_header(void);
+static block_sector_t log_sector(uint32_t pos);
+
+/* Initializes the journal.  If FORMAT is true, creates an empty
+   journal, otherwise brings the file system up to date by
+   replaying the journal. */
+void journal_init(bool format) {
+  lock_init(&journal_lock);
+  cond_init(&journal_cond);
+  handle_cnt = 0;
+  reserved = 0;
+  committing = false;
+  txn_cnt = 0;
+
+  io_buffer = malloc(BLOCK_SECTOR_SIZE);
+  if (io_buffer == NULL)
+    PANIC("can't allocate journal buffer");
+
+  if (format) {
+    head = tail = 0;
+    head_seq = tail_seq = 1;
+    write_header();
+  } else
+    replay();
+}
+
+/* Commits the running transaction and puts everything in place,
+   leaving the log empty.  Called when the file system is shut
+   down. */
+void journal_done(void) {
+  journal_commit();
+  lock_acquire(&journal_lock);
+  if (txn_cnt == 0)
+    checkpoint();
+  lock_release(&journal_lock);
+}
+
+/* Begins a handle: until the matching journal_end(), the sectors
+   that the running thread writes become part of the running
+   transaction.  CREDITS is the most sectors that the handle can
+   add to it.  Handles nest, and a nested handle adds its sectors
+   under the credits of the outermost one, so CREDITS is ignored
+   for it.  The outermost handle must be begun before acquiring
+   any other file system lock, because it may wait for a
+   commit. */
+void journal_begin(size_t credits) {
+  struct thread* cur = thread_current();
+
+  if (cur->journal_depth > 0) {
+    cur->journal_depth++;
+    return;
+  }
+
+  ASSERT(credits <= TXN_MAX);
+
+  lock_acquire(&journal_lock);
+  while (committing || txn_cnt >= TXN_SOFT_MAX || txn_cnt + reserved + credits > TXN_MAX) {
+    if (!committing)
+      commit();
+    else
+      cond_wait(&journal_cond, &journal_lock);
+  }
+  handle_cnt++;
+  reserved += credits;
+  lock_release(&journal_lock);
+  cur->journal_depth = 1;
+  cur->journal_credits = credits;
+}
+
+/* Ends a handle begun with journal_begin(). */
+void journal_end(void) {
+  struct thread* cur = thread_current();
+
+  ASSERT(cur->journal_depth > 0);
+  if (--cur->journal_depth > 0)
+    return;
+
+  lock_acquire(&journal_lock);
+  handle_cnt--;
+  reserved -= cur->journal_credits;
+  cur->journal_credits = 0;
+  cond_broadcast(&journal_cond, &journal_lock);
+  lock_release(&journal_lock);
+}
+
+/* Returns true if the running thread is inside a handle. */
+bool journal_active(void) { return thread_current()->journal_depth > 0; }
+
+/* Adds SECTOR, which the running thread has just modified in the
+   cache for the first time since the last commit, to the running
+   transaction, using up one of the handle's credits. */
+void journal_add(block_sector_t sector) {
+  struct thread* cur = thread_current();
+
+  ASSERT(journal_active());
+  ASSERT(cur->journal_credits > 0);
+
+  lock_acquire(&journal_lock);
+  ASSERT(txn_cnt < TXN_MAX);
+  cur->journal_credits--;
+  reserved--;
+  txn_sectors[txn_cnt++] = sector;
+  lock_release(&journal_lock);
+}
+
+/* Commits the running transaction to the journal, waiting for
+   the handles in progress to end first. */
+void journal_commit(void) {
+  lock_acquire(&journal_lock);
+  while (committing)
+    cond_wait(&journal_cond, &journal_lock);
+  if (txn_cnt > 0)
+    commit();
+  lock_release(&journal_lock);
+}
+
+/* Commits the running transaction.  journal_lock must be held,
+   and no commit may be in progress. */
+static void commit(void) {
+  struct journal_record* r = io_buffer;
+  size_t i;
+
+  ASSERT(lock_held_by_current_thread(&journal_lock));
+  ASSERT(!committing);
+
+  committing = true;
+  while (handle_cnt > 0)
+    cond_wait(&journal_cond, &journal_lock);
+
+  if (txn_cnt > 0) {
+    ASSERT(head - tail + txn_cnt + 2 <= LOG_SECTORS);
+
+    /* Descriptor. */
+    memset(r, 0, sizeof *r);
+    r->magic = DESCRIPTOR_MAGIC;
+    r->seq = head_seq;
+    r->cnt = txn_cnt;
+    memcpy(r->sectors, txn_sectors, txn_cnt * sizeof *txn_sectors);
+    block_write(fs_device, log_sector(head++), r);
+
+    /* Sector contents. */
+    for (i = 0; i < txn_cnt; i++) {
+      cache_read(txn_sectors[i], io_buffer, 0, BLOCK_SECTOR_SIZE);
+      block_write(fs_device, log_sector(head++), io_buffer);
+    }
+
+    /* Commit.  Once this is on disk, the transaction will survive
+       a crash, so its sectors may be written in place. */
+    memset(r, 0, sizeof *r);
+    r->magic = COMMIT_MAGIC;
+    r->seq = head_seq++;
+    r->cnt = txn_cnt;
+    block_write(fs_device, log_sector(head++), r);
+
+    for (i = 0; i < txn_cnt; i++)
+      cache_unjournal(txn_sectors[i]);
+    txn_cnt = 0;
+
+    /* Make room for the next transaction.  Nothing is journaled
+       now, so flushing the cache puts every committed sector in
+       place. */
+    if (head - tail + TXN_MAX + 2 > LOG_SECTORS)
+      checkpoint();
+  }
+
+  committing = false;
+  cond_broadcast(&journal_cond, &journal_lock);
+}
+
+/* Empties the log, after writing all of the committed sectors in
+   the cache in place.  journal_lock must be held, and no sector
+   may be part of the running transaction. */
+static void checkpoint(void) {
+  ASSERT(lock_held_by_current_thread(&journal_lock));
+  ASSERT(txn_cnt == 0);
+
+  cache_flush();
+  head = tail = head % LOG_SECTORS;
+  tail_seq = head_seq;
+  write_header();
+}
+
+/* Replays the complete transactions in the log, then empties
+   it. */
+static void replay(void) {
+  struct journal_header* h = io_buffer;
+  struct journal_record* desc;
+  struct journal_record* r = io_buffer;
+  size_t i;
+
+  block_read(fs_device, JOURNAL_SECTOR, h);
+  if (h->magic != HEADER_MAGIC)
+    PANIC("file system has no journal--reformat it");
+  head = tail = h->tail;
+  head_seq = tail_seq = h->seq;
+
+  desc = malloc(sizeof *desc);
+  if (desc == NULL)
+    PANIC("can't allocate journal descriptor");
+  for (;;) {
+    /* Check for a complete transaction. */
+    block_read(fs_device, log_sector(head), desc);
+    if (desc->magic != DESCRIPTOR_MAGIC || desc->seq != head_seq || desc->cnt > TXN_MAX)
+      break;
+    block_read(fs_device, log_sector(head + desc->cnt + 1), r);
+    if (r->magic != COMMIT_MAGIC || r->seq != head_seq)
+      break;
+
+    /* Copy its sectors in place. */
+    for (i = 0; i < desc->cnt; i++) {
+      block_read(fs_device, log_sector(head + 1 + i), io_buffer);
+      block_write(fs_device, desc->sectors[i], io_buffer);
+    }
+    head += desc->cnt + 2;
+    head_seq++;
+  }
+  free(desc);
+
+  if (head != tail)
+    printf("journal: replayed %u transactions\n", (unsigned)(head_seq - tail_seq));
+  head = tail = head % LOG_SECTORS;
+  tail_seq = head_seq;
+  write_header();
+}
+
+/* Writes the journal header to disk. */
+static void write_header(void) {
+  struct journal_header* h = io_buffer;
+
+  memset(h, 0, sizeof *h);
+  h->magic = HEADER_MAGIC;
+  h->tail = tail;
+  h->seq = tail_seq;
+  block_write(fs_device, JOURNAL_SECTOR, h);
+}
+
+/* Returns the device sector at log position POS. */
+static block_sector_t log_sector(uint32_t pos) { return JOURNAL_SECTOR + 1 + pos % LOG_SECTORS; }
@@ -0,0 +1,16 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+void journal_init(bool format);
+void journal_done(void);
+void journal_begin(size_t credits);
+void journal_end(void);
+bool journal_active(void);
+void journal_add(block_sector_t);
+void journal_commit(void);
+
+#endif /* filesys/journal.h */
@@ -0,0 +1,24 @@
+#ifndef __LIB_DIRENT_H
+#define __LIB_DIRENT_H
+
+/* Directory entries returned by the getdents system call.
+   Shared by the kernel and user programs. */
+
+/* Maximum length of a name in a directory entry. */
+#define DIRENT_NAME_MAX 14
+
+/* Type of the file a directory entry refers to. */
+enum dirent_type {
+  DT_UNKNOWN, /* Not known; use isdir() to find out. */
+  DT_REG,     /* Ordinary file. */
+  DT_DIR      /* Directory. */
+};
+
+/* A directory entry. */
+struct dirent {
+  int inumber;                     /* Inode number. */
+  unsigned char type;              /* One of enum dirent_type. */
+  char name[DIRENT_NAME_MAX + 1];  /* Null-terminated file name. */
+};
+
+#endif /* lib/dirent.h */
@@ -285,6 +285,20 @@ bool bitmap_write(const struct bitmap* b, struct file* file) {
   off_t size = byte_cnt(b->bit_cnt);
   return file_write_at(file, b->bits, size, 0) == size;
 }
+
+/* Writes the SIZE bytes starting at byte offset OFS of the image
+   of B that bitmap_write() would write to FILE, or as much of
+   them as lies within B.  Return true if successful, false
+   otherwise. */
+bool bitmap_write_part(const struct bitmap* b, struct file* file, off_t ofs, off_t size) {
+  off_t file_size = byte_cnt(b->bit_cnt);
+
+  if (ofs >= file_size)
+    return true;
+  if (size > file_size - ofs)
+    size = file_size - ofs;
+  return file_write_at(file, (const uint8_t*)b->bits + ofs, size, ofs) == size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -39,10 +39,12 @@ size_t bitmap_scan_and_flip(struct bitmap*, size_t start, size_t cnt, bool);
 
 /* File input and output. */
 #ifdef FILESYS
+#include "filesys/off_t.h"
 struct file;
 size_t bitmap_file_size(const struct bitmap*);
 bool bitmap_read(struct bitmap*, struct file*);
 bool bitmap_write(const struct bitmap*, struct file*);
+bool bitmap_write_part(const struct bitmap*, struct file*, off_t ofs, off_t size);
 #endif
 
 /* Debugging. */
@@ -37,6 +37,11 @@
 #define SSTATUS_SIE         0x00000002
 #define SSTATUS_SPIE        0x00000020
 #define SSTATUS_SPP         0x00000100
+#define SSTATUS_FS          0x00006000
+#define SSTATUS_FS_OFF      0x00000000
+#define SSTATUS_FS_INITIAL  0x00002000
+#define SSTATUS_FS_CLEAN    0x00004000
+#define SSTATUS_FS_DIRTY    0x00006000
 #define SSTATUS_SUM         0x00040000
 
 
@@ -96,6 +101,29 @@
 ({								\
 	asm volatile("sfence.vma");  \
 })
+
+/* Flushes the translations cached for virtual address VA in all
+   address spaces. */
+#define sfence_vma_addr(va)					\
+({								\
+	asm volatile("sfence.vma %0, zero"			\
+			      : : "r" (va) : "memory");		\
+})
+
+/* Flushes the translations cached for virtual address VA in
+   address space ASID. */
+#define sfence_vma_addr_asid(va, asid)				\
+({								\
+	asm volatile("sfence.vma %0, %1"			\
+			      : : "r" (va), "r" (asid) : "memory");	\
+})
+
+/* Flushes the translations cached for address space ASID. */
+#define sfence_vma_asid(asid)					\
+({								\
+	asm volatile("sfence.vma zero, %0"			\
+			      : : "r" (asid) : "memory");	\
+})
 #endif /* __ASSEMBLER__ */
 
 #if __riscv_xlen == 32
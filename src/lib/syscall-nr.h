@@ -39,7 +39,9 @@ enum {
   SYS_MKDIR,   /* Create a directory. */
   SYS_READDIR, /* Reads a directory entry. */
   SYS_ISDIR,   /* Tests if a fd represents a directory. */
-  SYS_INUMBER  /* Returns the inode number for a fd. */
+  SYS_INUMBER, /* Returns the inode number for a fd. */
+  SYS_FSYNC,   /* Writes a file's data to disk. */
+  SYS_GETDENTS /* Reads many directory entries at once. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -136,6 +136,12 @@ bool isdir(int fd) { return syscall1(SYS_ISDIR, fd); }
 
 int inumber(int fd) { return syscall1(SYS_INUMBER, fd); }
 
+bool fsync(int fd) { return syscall1(SYS_FSYNC, fd); }
+
+int getdents(int fd, struct dirent* entries, unsigned cnt) {
+  return syscall3(SYS_GETDENTS, fd, entries, cnt);
+}
+
 double compute_e(int n) { return (double)syscall1f(SYS_COMPUTE_E, n); }
 
 tid_t sys_pthread_create(stub_fun sfun, pthread_fun tfun, const void* arg) {
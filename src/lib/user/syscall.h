@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <dirent.h>
 #include <pthread.h>
 
 /* Process identifier. */
@@ -61,5 +62,7 @@ bool mkdir(const char* dir);
 bool readdir(int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir(int fd);
 int inumber(int fd);
+bool fsync(int fd);
+int getdents(int fd, struct dirent*, unsigned cnt);
 
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,39 @@
+/* Child process for syn-read-lg.
+   Reads the test file a sector at a time, from the last sector
+   to the first, so that its first read looks up the end of a
+   file whose sectors have not been looked up yet, while the
+   other children do the same. */
+
+#include <random.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-read-lg.h"
+#include "tests/lib.h"
+
+static char buf1[BUF_SIZE];
+static char buf2[512];
+
+int main(int argc, const char* argv[]) {
+  int child_idx;
+  int fd;
+  size_t i;
+
+  test_name = "child-syn-read-lg";
+  quiet = true;
+
+  CHECK(argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi(argv[1]);
+
+  random_init(0);
+  random_bytes(buf1, sizeof buf1);
+
+  CHECK((fd = open(file_name)) > 1, "open \"%s\"", file_name);
+  for (i = SECTOR_CNT; i-- > 0;) {
+    seek(fd, i * sizeof buf2);
+    CHECK(read(fd, buf2, sizeof buf2) == (int)sizeof buf2, "read \"%s\"", file_name);
+    compare_bytes(buf2, buf1 + i * sizeof buf2, sizeof buf2, i * sizeof buf2, file_name);
+  }
+  close(fd);
+
+  return child_idx;
+}
@@ -0,0 +1,37 @@
+/* Tests that getdents() returns every entry in a directory,
+   batch by batch, and then returns 0. */
+
+#include <dirent.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  struct dirent entries[2];
+  bool found_a = false, found_b = false, found_c = false;
+  int fd, cnt, i;
+
+  CHECK(create("a", 0), "create \"a\"");
+  CHECK(create("b", 0), "create \"b\"");
+  CHECK(create("c", 0), "create \"c\"");
+  CHECK((fd = open("/")) > 1, "open \"/\"");
+  msg("getdents \"/\"");
+  while ((cnt = getdents(fd, entries, sizeof entries / sizeof *entries)) > 0)
+    for (i = 0; i < cnt; i++) {
+      if (!strcmp(entries[i].name, "a"))
+        found_a = true;
+      else if (!strcmp(entries[i].name, "b"))
+        found_b = true;
+      else if (!strcmp(entries[i].name, "c"))
+        found_c = true;
+      else
+        fail("unexpected entry \"%s\"", entries[i].name);
+    }
+  if (cnt < 0)
+    fail("getdents failed");
+  if (!found_a || !found_b || !found_c)
+    fail("missing entry");
+  msg("close \"/\"");
+  close(fd);
+}
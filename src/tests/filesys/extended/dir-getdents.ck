@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-getdents) begin
+(dir-getdents) create "a"
+(dir-getdents) create "b"
+(dir-getdents) create "c"
+(dir-getdents) open "/"
+(dir-getdents) getdents "/"
+(dir-getdents) close "/"
+(dir-getdents) end
+EOF
+pass;
@@ -0,0 +1,35 @@
+/* Creates 40 files in the root directory, syncing each one as it
+   is written.  Each sync commits a journal transaction, so the
+   journal fills up and has to be emptied several times. */
+
+#include <syscall.h>
+#include <stdio.h>
+#include "tests/filesys/seq-test.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 40
+
+static char buf[512];
+
+static size_t return_block_size(void) { return sizeof buf; }
+
+static void sync_file(int fd, long ofs UNUSED) {
+  if (!fsync(fd))
+    fail("fsync failed");
+}
+
+void test_main(void) {
+  size_t i;
+
+  for (i = 0; i < FILE_CNT; i++) {
+    char file_name[128];
+    snprintf(file_name, sizeof file_name, "file%zu", i);
+
+    msg("creating and checking \"%s\"", file_name);
+
+    quiet = true;
+    seq_test(file_name, buf, sizeof buf, sizeof buf, return_block_size, sync_file);
+    quiet = false;
+  }
+}
@@ -0,0 +1,49 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-fsync) begin
+(grow-fsync) creating and checking "file0"
+(grow-fsync) creating and checking "file1"
+(grow-fsync) creating and checking "file2"
+(grow-fsync) creating and checking "file3"
+(grow-fsync) creating and checking "file4"
+(grow-fsync) creating and checking "file5"
+(grow-fsync) creating and checking "file6"
+(grow-fsync) creating and checking "file7"
+(grow-fsync) creating and checking "file8"
+(grow-fsync) creating and checking "file9"
+(grow-fsync) creating and checking "file10"
+(grow-fsync) creating and checking "file11"
+(grow-fsync) creating and checking "file12"
+(grow-fsync) creating and checking "file13"
+(grow-fsync) creating and checking "file14"
+(grow-fsync) creating and checking "file15"
+(grow-fsync) creating and checking "file16"
+(grow-fsync) creating and checking "file17"
+(grow-fsync) creating and checking "file18"
+(grow-fsync) creating and checking "file19"
+(grow-fsync) creating and checking "file20"
+(grow-fsync) creating and checking "file21"
+(grow-fsync) creating and checking "file22"
+(grow-fsync) creating and checking "file23"
+(grow-fsync) creating and checking "file24"
+(grow-fsync) creating and checking "file25"
+(grow-fsync) creating and checking "file26"
+(grow-fsync) creating and checking "file27"
+(grow-fsync) creating and checking "file28"
+(grow-fsync) creating and checking "file29"
+(grow-fsync) creating and checking "file30"
+(grow-fsync) creating and checking "file31"
+(grow-fsync) creating and checking "file32"
+(grow-fsync) creating and checking "file33"
+(grow-fsync) creating and checking "file34"
+(grow-fsync) creating and checking "file35"
+(grow-fsync) creating and checking "file36"
+(grow-fsync) creating and checking "file37"
+(grow-fsync) creating and checking "file38"
+(grow-fsync) creating and checking "file39"
+(grow-fsync) end
+EOF
+pass;
@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"sparse" => ["\0" x 799999 . "x"]});
+pass;
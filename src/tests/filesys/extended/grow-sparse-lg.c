@@ -0,0 +1,58 @@
+/* Tests that seeking far past the end of a file and writing
+   leaves the region in between as a hole, which reads as zeros
+   and takes up no disk space.  The file system holds 2 MB, which
+   is too little for both the sparse file and the file written
+   after it unless the hole stays unallocated. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SPARSE_SIZE 800000
+#define CHUNK_SIZE 65536
+#define CHUNK_CNT 20
+
+static char buf[CHUNK_SIZE];
+
+void test_main(void) {
+  const char* sparse_name = "sparse";
+  const char* fill_name = "fill";
+  char last = 'x';
+  int fd;
+  size_t i;
+
+  CHECK(create(sparse_name, 0), "create \"%s\"", sparse_name);
+  CHECK((fd = open(sparse_name)) > 1, "open \"%s\"", sparse_name);
+  msg("seek \"%s\"", sparse_name);
+  seek(fd, SPARSE_SIZE - 1);
+  CHECK(write(fd, &last, 1) > 0, "write \"%s\"", sparse_name);
+  msg("close \"%s\"", sparse_name);
+  close(fd);
+
+  CHECK(create(fill_name, 0), "create \"%s\"", fill_name);
+  CHECK((fd = open(fill_name)) > 1, "open \"%s\"", fill_name);
+  msg("write %d bytes to \"%s\"", CHUNK_SIZE * CHUNK_CNT, fill_name);
+  for (i = 0; i < CHUNK_CNT; i++)
+    if (write(fd, buf, sizeof buf) != (int)sizeof buf)
+      fail("write %zu bytes at offset %zu in \"%s\" failed", sizeof buf, i * sizeof buf,
+           fill_name);
+  msg("close \"%s\"", fill_name);
+  close(fd);
+
+  CHECK((fd = open(sparse_name)) > 1, "open \"%s\" for verification", sparse_name);
+  for (i = 0; i < SPARSE_SIZE / CHUNK_SIZE; i++) {
+    size_t j;
+
+    if (read(fd, buf, sizeof buf) != (int)sizeof buf)
+      fail("read %zu bytes at offset %zu in \"%s\" failed", sizeof buf, i * sizeof buf,
+           sparse_name);
+    for (j = 0; j < sizeof buf; j++)
+      if (buf[j] != 0)
+        fail("byte %zu in \"%s\" is %d, not 0", i * sizeof buf + j, sparse_name, buf[j]);
+  }
+  msg("verified hole in \"%s\"", sparse_name);
+  msg("close \"%s\"", sparse_name);
+  close(fd);
+
+  CHECK(remove(fill_name), "remove \"%s\"", fill_name);
+}
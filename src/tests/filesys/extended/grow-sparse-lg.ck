@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-sparse-lg) begin
+(grow-sparse-lg) create "sparse"
+(grow-sparse-lg) open "sparse"
+(grow-sparse-lg) seek "sparse"
+(grow-sparse-lg) write "sparse"
+(grow-sparse-lg) close "sparse"
+(grow-sparse-lg) create "fill"
+(grow-sparse-lg) open "fill"
+(grow-sparse-lg) write 1310720 bytes to "fill"
+(grow-sparse-lg) close "fill"
+(grow-sparse-lg) open "sparse" for verification
+(grow-sparse-lg) verified hole in "sparse"
+(grow-sparse-lg) close "sparse"
+(grow-sparse-lg) remove "fill"
+(grow-sparse-lg) end
+EOF
+pass;
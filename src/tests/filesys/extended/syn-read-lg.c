@@ -0,0 +1,28 @@
+/* Spawns 4 child processes, all of which read the same large
+   file at once, starting from its end, and make sure that the
+   contents are what they should be. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-read-lg.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[BUF_SIZE];
+
+#define CHILD_CNT 4
+
+void test_main(void) {
+  pid_t children[CHILD_CNT];
+  int fd;
+
+  CHECK(create(file_name, 0), "create \"%s\"", file_name);
+  CHECK((fd = open(file_name)) > 1, "open \"%s\"", file_name);
+  random_bytes(buf, sizeof buf);
+  CHECK(write(fd, buf, sizeof buf) == (int)sizeof buf, "write \"%s\"", file_name);
+  msg("close \"%s\"", file_name);
+  close(fd);
+
+  exec_children("child-syn-read-lg", children, CHILD_CNT);
+  wait_children(children, CHILD_CNT);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(syn-read-lg) begin
+(syn-read-lg) create "data"
+(syn-read-lg) open "data"
+(syn-read-lg) write "data"
+(syn-read-lg) close "data"
+(syn-read-lg) exec child 1 of 4: "child-syn-read-lg 0"
+(syn-read-lg) exec child 2 of 4: "child-syn-read-lg 1"
+(syn-read-lg) exec child 3 of 4: "child-syn-read-lg 2"
+(syn-read-lg) exec child 4 of 4: "child-syn-read-lg 3"
+(syn-read-lg) wait for child 1 of 4 returned 0 (expected 0)
+(syn-read-lg) wait for child 2 of 4 returned 1 (expected 1)
+(syn-read-lg) wait for child 3 of 4 returned 2 (expected 2)
+(syn-read-lg) wait for child 4 of 4 returned 3 (expected 3)
+(syn-read-lg) end
+EOF
+pass;
@@ -0,0 +1,9 @@
+#ifndef TESTS_FILESYS_EXTENDED_SYN_READ_LG_H
+#define TESTS_FILESYS_EXTENDED_SYN_READ_LG_H
+
+/* Large enough to need the doubly indirect block. */
+#define SECTOR_CNT 300
+#define BUF_SIZE (SECTOR_CNT * 512)
+static const char file_name[] = "data";
+
+#endif /* tests/filesys/extended/syn-read-lg.h */
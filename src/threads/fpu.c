@@ -0,0 +1,228 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <riscv.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* Lazy floating-point context switching.
+
+   The FP register file is saved and restored only when a
+   different context actually needs it.  The FS field of sstatus
+   tells the hardware whether FP instructions are allowed:
+   whenever the code that is running does not own the registers,
+   FS is Off, so that its first FP instruction raises an
+   illegal-instruction exception.  fpu_handle_trap() then saves
+   the previous owner's registers, but only if the hardware marked
+   them Dirty, and loads the registers of the faulting context.
+
+   As a result, threads and processes that never touch the FPU
+   never pay for saving or restoring it.  The saved state of each
+   context is allocated on its first FP instruction; a context
+   that was never saved starts out with all registers zero.
+
+   The ownership state below is only modified with interrupts
+   off. */
+
+/* Owner of the contents of the FP registers, or a null pointer
+   if the registers hold nothing worth saving. */
+static struct thread* fpu_owner;
+static enum fpu_level fpu_owner_level;
+
+/* True if the registers have been modified since they were
+   loaded from fpu_owner's saved context.  The hardware tracks
+   this in FS only while the owner is running, so it is folded
+   in here whenever the owner stops running. */
+static bool fpu_dirty;
+
+static void set_fs(unsigned long fs);
+static unsigned long fs_for(struct thread*, enum fpu_level);
+static void note_dirty(unsigned long status);
+static bool is_fp_instruction(const void* pc);
+static void save_registers(struct fpu_context*);
+static void load_registers(const struct fpu_context*);
+
+/* Initializes lazy FP switching.  The registers start out
+   unowned, with FP instructions disabled. */
+void fpu_init(void) {
+  fpu_owner = NULL;
+  fpu_dirty = false;
+  set_fs(SSTATUS_FS_OFF);
+}
+
+/* Called on entry to the kernel with the interrupted context in
+   F.  If F was a user process, the kernel code about to run uses
+   a different context, so FP instructions are turned off unless
+   that context already owns the registers. */
+void fpu_trap_entry(struct intr_frame* f) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (!(f->status & SSTATUS_SPP)) {
+    note_dirty(f->status);
+    set_fs(fs_for(thread_current(), FPU_KERNEL));
+  }
+}
+
+/* Called just before returning to the interrupted context in F.
+   Sets F's FS field to reflect whether that context owns the FP
+   registers, which may have changed while we were in the
+   kernel.
+
+   Interrupts are left off, so that ownership cannot change
+   again before intr_exit restores sstatus from F. */
+void fpu_trap_exit(struct intr_frame* f) {
+  unsigned long fs;
+
+  intr_disable();
+  if (!(f->status & SSTATUS_SPP)) {
+    note_dirty(csr_read(CSR_SSTATUS));
+    fs = fs_for(thread_current(), FPU_USER);
+  } else
+    fs = csr_read(CSR_SSTATUS) & SSTATUS_FS;
+  f->status = (f->status & ~SSTATUS_FS) | fs;
+}
+
+/* Handles an illegal-instruction exception described by F.  If
+   it was caused by an FP instruction executed with FP disabled,
+   switches the FP registers to the faulting context and returns
+   true, so that the instruction is retried.  Otherwise, returns
+   false. */
+bool fpu_handle_trap(struct intr_frame* f) {
+  struct thread* cur = thread_current();
+  enum fpu_level level = f->status & SSTATUS_SPP ? FPU_KERNEL : FPU_USER;
+  struct fpu_context** ctx = &cur->fpu[level];
+  enum intr_level old_level;
+
+  if ((f->status & SSTATUS_FS) != SSTATUS_FS_OFF || !is_fp_instruction((void*)f->epc))
+    return false;
+
+  /* The FPU must not be used by interrupt handlers. */
+  ASSERT(!intr_context());
+
+  if (*ctx == NULL) {
+    *ctx = calloc(1, sizeof **ctx);
+    if (*ctx == NULL)
+      return false;
+  }
+
+  old_level = intr_disable();
+  set_fs(SSTATUS_FS_INITIAL);
+  if (fpu_owner != NULL && fpu_dirty)
+    save_registers(fpu_owner->fpu[fpu_owner_level]);
+  load_registers(*ctx);
+  fpu_owner = cur;
+  fpu_owner_level = level;
+  fpu_dirty = false;
+  set_fs(fs_for(cur, FPU_KERNEL));
+  intr_set_level(old_level);
+
+  return true;
+}
+
+/* Called by thread_switch_tail() after switching threads, with
+   interrupts off.  The hardware's dirty bit belongs to the thread
+   we switched away from; record it, then enable FP instructions
+   for the new thread only if its kernel context owns the
+   registers. */
+void fpu_switch(void) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  note_dirty(csr_read(CSR_SSTATUS));
+  set_fs(fs_for(thread_current(), FPU_KERNEL));
+}
+
+/* Releases the running thread's FP contexts.  Called by
+   thread_exit(). */
+void fpu_exit(void) {
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
+  int i;
+
+  old_level = intr_disable();
+  if (fpu_owner == cur) {
+    fpu_owner = NULL;
+    fpu_dirty = false;
+  }
+  set_fs(SSTATUS_FS_OFF);
+  intr_set_level(old_level);
+
+  for (i = 0; i < FPU_LEVEL_CNT; i++) {
+    free(cur->fpu[i]);
+    cur->fpu[i] = NULL;
+  }
+}
+
+/* Sets the FS field of sstatus to FS. */
+static void set_fs(unsigned long fs) {
+  csr_write(CSR_SSTATUS, (csr_read(CSR_SSTATUS) & ~SSTATUS_FS) | fs);
+}
+
+/* Returns the FS field for code running in context LEVEL of
+   thread T: Off if the context does not own the registers,
+   otherwise Clean or Dirty. */
+static unsigned long fs_for(struct thread* t, enum fpu_level level) {
+  if (fpu_owner != t || fpu_owner_level != level)
+    return SSTATUS_FS_OFF;
+  return fpu_dirty ? SSTATUS_FS_DIRTY : SSTATUS_FS_CLEAN;
+}
+
+/* Records that the registers were modified if the FS field of
+   STATUS, saved from the owner of the registers, says so. */
+static void note_dirty(unsigned long status) {
+  if ((status & SSTATUS_FS) == SSTATUS_FS_DIRTY)
+    fpu_dirty = true;
+}
+
+/* Returns true if the instruction at PC accesses the FP
+   registers.  PC was just fetched, so it is known to be
+   mapped. */
+static bool is_fp_instruction(const void* pc) {
+  const uint16_t* parcel = pc;
+  uint32_t insn;
+
+  if ((parcel[0] & 0x3) != 0x3) {
+    /* Compressed instruction.  In quadrants 0 and 2, the odd
+       values of funct3 are the FP loads and stores (C.FLD,
+       C.FLW, C.FSD, C.FSW and their stack-relative forms). */
+    unsigned quadrant = parcel[0] & 0x3;
+    unsigned funct3 = parcel[0] >> 13;
+    return (quadrant == 0 || quadrant == 2) && (funct3 & 1) != 0;
+  }
+
+  insn = parcel[0] | (uint32_t)parcel[1] << 16;
+  switch (insn & 0x7f) {
+    case 0x07: /* LOAD-FP. */
+    case 0x27: /* STORE-FP. */
+    case 0x43: /* MADD. */
+    case 0x47: /* MSUB. */
+    case 0x4b: /* NMSUB. */
+    case 0x4f: /* NMADD. */
+    case 0x53: /* OP-FP. */
+      return true;
+    case 0x73: /* SYSTEM: CSR access to fflags, frm, or fcsr. */
+      return ((insn >> 12) & 0x7) != 0 && (insn >> 20) >= 0x001 && (insn >> 20) <= 0x003;
+    default:
+      return false;
+  }
+}
+
+#define FSD(N) "fsd f" #N ", " #N "*8(%0)\n\t"
+#define FLD(N) "fld f" #N ", " #N "*8(%0)\n\t"
+#define FP_REGS(OP)                                                                                \
+  OP(0) OP(1) OP(2) OP(3) OP(4) OP(5) OP(6) OP(7) OP(8) OP(9) OP(10) OP(11) OP(12) OP(13) OP(14)   \
+  OP(15) OP(16) OP(17) OP(18) OP(19) OP(20) OP(21) OP(22) OP(23) OP(24) OP(25) OP(26) OP(27)       \
+  OP(28) OP(29) OP(30) OP(31)
+
+/* Saves the FP registers into CTX.  FP instructions must be
+   enabled. */
+static void save_registers(struct fpu_context* ctx) {
+  asm volatile(FP_REGS(FSD) : : "r"(ctx->f) : "memory");
+  asm volatile("frcsr %0" : "=r"(ctx->fcsr));
+}
+
+/* Loads the FP registers from CTX.  FP instructions must be
+   enabled. */
+static void load_registers(const struct fpu_context* ctx) {
+  asm volatile(FP_REGS(FLD) : : "r"(ctx->f) : "memory");
+  asm volatile("fscsr %0" : : "r"(ctx->fcsr));
+}
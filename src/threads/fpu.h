@@ -0,0 +1,32 @@
+#ifndef THREADS_FPU_H
+#define THREADS_FPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct intr_frame;
+
+/* Privilege levels that own a floating-point context.  Kernel
+   code running on behalf of a thread uses a context separate
+   from the one of the thread's user process, so that it cannot
+   clobber the user's registers. */
+enum fpu_level {
+  FPU_USER,  /* User process. */
+  FPU_KERNEL /* Kernel code. */
+};
+#define FPU_LEVEL_CNT 2
+
+/* Saved floating-point registers. */
+struct fpu_context {
+  uint64_t f[32]; /* f0...f31. */
+  uint32_t fcsr;  /* Rounding mode and accrued exceptions. */
+};
+
+void fpu_init(void);
+void fpu_trap_entry(struct intr_frame*);
+void fpu_trap_exit(struct intr_frame*);
+bool fpu_handle_trap(struct intr_frame*);
+void fpu_switch(void);
+void fpu_exit(void);
+
+#endif /* threads/fpu.h */
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <riscv.h>
+#include "threads/fpu.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
 #include "threads/thread.h"
@@ -257,6 +258,10 @@ void intr_handler(struct intr_frame* frame) {
   long old_cause;
   intr_handler_func* handler;
 
+#ifndef MACHINE
+  fpu_trap_entry(frame);
+#endif
+
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
      and they need to be acknowledged on the PLIC (see below).
@@ -326,6 +331,10 @@ void intr_handler(struct intr_frame* frame) {
       thread_yield();
     #endif
   }
+
+#ifndef MACHINE
+  fpu_trap_exit(frame);
+#endif
 }
 
 #define PRIx PRIxLONG
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -32,7 +33,20 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   Taking a descriptor's lock can block, so each descriptor also
+   has a small "magazine" of free blocks in front of its free
+   list, protected only by briefly disabling interrupts (there is
+   a single hart).  malloc() and free() normally just pop and push
+   the magazine.  When it runs empty or full, half a magazine's
+   worth of blocks is moved from or to the free list at once,
+   under the lock.  Blocks in a magazine still count as in use in
+   their arena, so an arena is not released while the magazine
+   holds one of its blocks. */
+
+/* Number of blocks in a magazine. */
+#define MAG_SIZE 16
 
 /* Descriptor. */
 struct desc {
@@ -40,6 +54,10 @@ struct desc {
   size_t blocks_per_arena; /* Number of blocks in an arena. */
   struct list free_list;   /* List of free blocks. */
   struct lock lock;        /* Lock. */
+
+  /* Magazine.  Only accessed with interrupts off. */
+  struct block* mag[MAG_SIZE]; /* Free blocks. */
+  size_t mag_cnt;              /* Number of blocks in mag. */
 };
 
 /* Magic number for detecting arena corruption. */
@@ -63,6 +81,9 @@ static size_t desc_cnt;       /* Number of descriptors. */
 
 static struct arena* block_to_arena(struct block*);
 static struct block* arena_to_block(struct arena*, size_t idx);
+static struct block* refill_magazine(struct desc*);
+static void drain_magazine(struct desc*, struct block*);
+static void free_block(struct desc*, struct block*);
 
 /* Initializes the malloc() descriptors. */
 void malloc_init(void) {
@@ -75,6 +96,7 @@ void malloc_init(void) {
     d->blocks_per_arena = (PGSIZE - sizeof(struct arena)) / block_size;
     list_init(&d->free_list);
     lock_init(&d->lock);
+    d->mag_cnt = 0;
   }
 }
 
@@ -82,8 +104,9 @@ void malloc_init(void) {
    Returns a null pointer if memory is not available. */
 void* malloc(size_t size) {
   struct desc* d;
-  struct block* b;
+  struct block* b = NULL;
   struct arena* a;
+  enum intr_level old_level;
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
@@ -110,6 +133,24 @@ void* malloc(size_t size) {
     return a + 1;
   }
 
+  /* Take a block from the magazine if we can. */
+  old_level = intr_disable();
+  if (d->mag_cnt > 0)
+    b = d->mag[--d->mag_cnt];
+  intr_set_level(old_level);
+
+  return b != NULL ? b : refill_magazine(d);
+}
+
+/* Moves up to half a magazine's worth of blocks from D's free
+   list into D's magazine, creating a new arena if the free list
+   is empty, and returns one more block for the caller.  Returns
+   a null pointer if memory is not available. */
+static struct block* refill_magazine(struct desc* d) {
+  struct block* b;
+  struct arena* a;
+  enum intr_level old_level;
+
   lock_acquire(&d->lock);
 
   /* If the free list is empty, create a new arena. */
@@ -133,10 +174,19 @@ void* malloc(size_t size) {
     }
   }
 
-  /* Get a block from free list and return it. */
+  /* Get a block from free list for the caller. */
   b = list_entry(list_pop_front(&d->free_list), struct block, free_elem);
-  a = block_to_arena(b);
-  a->free_cnt--;
+  block_to_arena(b)->free_cnt--;
+
+  /* Move more into the magazine, leaving it at most half full. */
+  old_level = intr_disable();
+  while (d->mag_cnt < MAG_SIZE / 2 && !list_empty(&d->free_list)) {
+    struct block* extra = list_entry(list_pop_front(&d->free_list), struct block, free_elem);
+    block_to_arena(extra)->free_cnt--;
+    d->mag[d->mag_cnt++] = extra;
+  }
+  intr_set_level(old_level);
+
   lock_release(&d->lock);
   return b;
 }
@@ -201,30 +251,24 @@ void free(void* p) {
 
     if (d != NULL) {
       /* It's a normal block.  We handle it here. */
+      enum intr_level old_level;
+      bool stashed = false;
 
 #ifndef NDEBUG
       /* Clear the block to help detect use-after-free bugs. */
       memset(b, 0xcc, d->block_size);
 #endif
 
-      lock_acquire(&d->lock);
-
-      /* Add block to free list. */
-      list_push_front(&d->free_list, &b->free_elem);
-
-      /* If the arena is now entirely unused, free it. */
-      if (++a->free_cnt >= d->blocks_per_arena) {
-        size_t i;
-
-        ASSERT(a->free_cnt == d->blocks_per_arena);
-        for (i = 0; i < d->blocks_per_arena; i++) {
-          struct block* b = arena_to_block(a, i);
-          list_remove(&b->free_elem);
-        }
-        palloc_free_page(a);
+      /* Put it in the magazine if there is room. */
+      old_level = intr_disable();
+      if (d->mag_cnt < MAG_SIZE) {
+        d->mag[d->mag_cnt++] = b;
+        stashed = true;
       }
+      intr_set_level(old_level);
 
-      lock_release(&d->lock);
+      if (!stashed)
+        drain_magazine(d, b);
     } else {
       /* It's a big block.  Free its pages. */
       palloc_free_multiple(a, a->free_cnt);
@@ -233,6 +277,49 @@ void free(void* p) {
   }
 }
 
+/* Returns B and half of the blocks in D's magazine to D's free
+   list. */
+static void drain_magazine(struct desc* d, struct block* b) {
+  enum intr_level old_level;
+
+  lock_acquire(&d->lock);
+
+  free_block(d, b);
+  for (;;) {
+    old_level = intr_disable();
+    b = d->mag_cnt > MAG_SIZE / 2 ? d->mag[--d->mag_cnt] : NULL;
+    intr_set_level(old_level);
+    if (b == NULL)
+      break;
+    free_block(d, b);
+  }
+
+  lock_release(&d->lock);
+}
+
+/* Adds block B to D's free list, freeing its arena if it is now
+   entirely unused.  D's lock must be held. */
+static void free_block(struct desc* d, struct block* b) {
+  struct arena* a = block_to_arena(b);
+
+  ASSERT(lock_held_by_current_thread(&d->lock));
+
+  /* Add block to free list. */
+  list_push_front(&d->free_list, &b->free_elem);
+
+  /* If the arena is now entirely unused, free it. */
+  if (++a->free_cnt >= d->blocks_per_arena) {
+    size_t i;
+
+    ASSERT(a->free_cnt == d->blocks_per_arena);
+    for (i = 0; i < d->blocks_per_arena; i++) {
+      struct block* b = arena_to_block(a, i);
+      list_remove(&b->free_elem);
+    }
+    palloc_free_page(a);
+  }
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena* block_to_arena(struct block* b) {
   struct arena* a = pg_round_down(b);
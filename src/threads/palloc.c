@@ -2,13 +2,14 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,13 +24,50 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is managed as a buddy system.  Free pages are kept
+   in blocks of 2**ORDER pages, aligned (relative to the pool's
+   base) to their size, on one free list per order.  A request
+   for N pages takes a block of the smallest sufficient order,
+   splitting larger blocks as needed, and gives the pages beyond
+   N back.  Freeing a block merges it with its buddy, the other
+   half of the block of the next order, for as long as the buddy
+   is free too.  Both take time logarithmic in the pool size,
+   however fragmented the pool is.
+
+   The pools are also used from thread_switch_tail(), where
+   blocking on a lock is not allowed, so they are protected by
+   disabling interrupts instead.
+
+   To keep zeroing out of the callers' critical paths, the idle
+   thread also zeroes single pages ahead of time, using
+   palloc_zero_idle(), and each pool keeps up to ZEROED_MAX of
+   them for PAL_ZERO requests.  These pages are handed back to
+   the buddy system if memory runs out. */
+
+/* Largest block order. */
+#define MAX_ORDER 16
+
+/* Maximum number of pre-zeroed pages per pool. */
+#define ZEROED_MAX 64
 
 /* A memory pool. */
 struct pool {
-  struct lock lock;        /* Mutual exclusion. */
-  struct bitmap* used_map; /* Bitmap of free pages. */
-  uint8_t* base;           /* Base of pool. */
+  struct bitmap* used_map;                 /* Bitmap of allocated pages. */
+  uint8_t* free_order;                     /* For each page, 1 + order of the free
+                                              block it starts, or 0. */
+  struct list free_lists[MAX_ORDER + 1];   /* Free blocks, by order. */
+  size_t page_cnt;                         /* Number of pages. */
+  uint8_t* base;                           /* Base of pool. */
+  struct list zeroed;                      /* Pre-zeroed pages. */
+  size_t zeroed_cnt;                       /* Number of pages in zeroed. */
+};
+
+/* Free block, stored in its first page.  Also used for the
+   pre-zeroed pages, which are otherwise all zeros. */
+struct free_block {
+  struct list_elem elem; /* Element in a free list. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -37,6 +75,10 @@ static struct pool kernel_pool, user_pool;
 
 static void init_pool(struct pool*, void* base, size_t page_cnt, const char* name);
 static bool page_from_pool(const struct pool*, void* page);
+static size_t alloc_pages(struct pool*, size_t page_cnt);
+static void free_pages(struct pool*, size_t page_idx, size_t page_cnt);
+static void free_block(struct pool*, size_t page_idx, int order);
+static void release_zeroed(struct pool*);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -64,23 +106,34 @@ void palloc_init(size_t user_page_limit) {
    FLAGS, in which case the kernel panics. */
 void* palloc_get_multiple(enum palloc_flags flags, size_t page_cnt) {
   struct pool* pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-  void* pages;
+  void* pages = NULL;
   size_t page_idx;
+  bool zeroed = false;
+  enum intr_level old_level;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire(&pool->lock);
-  page_idx = bitmap_scan_and_flip(pool->used_map, 0, page_cnt, false);
-  lock_release(&pool->lock);
-
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
-  else
-    pages = NULL;
+  old_level = intr_disable();
+  if (page_cnt == 1 && (flags & PAL_ZERO) && !list_empty(&pool->zeroed)) {
+    pages = list_entry(list_pop_front(&pool->zeroed), struct free_block, elem);
+    pool->zeroed_cnt--;
+    zeroed = true;
+  } else {
+    page_idx = alloc_pages(pool, page_cnt);
+    if (page_idx == BITMAP_ERROR && pool->zeroed_cnt > 0) {
+      release_zeroed(pool);
+      page_idx = alloc_pages(pool, page_cnt);
+    }
+    if (page_idx != BITMAP_ERROR)
+      pages = pool->base + PGSIZE * page_idx;
+  }
+  intr_set_level(old_level);
 
   if (pages != NULL) {
-    if (flags & PAL_ZERO)
+    if (zeroed)
+      memset(pages, 0, sizeof(struct free_block));
+    else if (flags & PAL_ZERO)
       memset(pages, 0, PGSIZE * page_cnt);
   } else {
     if (flags & PAL_ASSERT)
@@ -103,6 +156,7 @@ void* palloc_get_page(enum palloc_flags flags) { return palloc_get_multiple(flag
 void palloc_free_multiple(void* pages, size_t page_cnt) {
   struct pool* pool;
   size_t page_idx;
+  enum intr_level old_level;
 
   ASSERT(pg_ofs(pages) == 0);
   if (pages == NULL || page_cnt == 0)
@@ -121,30 +175,77 @@ void palloc_free_multiple(void* pages, size_t page_cnt) {
   memset(pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT(bitmap_all(pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple(pool->used_map, page_idx, page_cnt, false);
+  old_level = intr_disable();
+  free_pages(pool, page_idx, page_cnt);
+  intr_set_level(old_level);
 }
 
 /* Frees the page at PAGE. */
 void palloc_free_page(void* page) { palloc_free_multiple(page, 1); }
 
+/* Zeroes a free page ahead of time for a later PAL_ZERO request,
+   if a pool is short of them.  Returns true if it zeroed a page,
+   false if there was nothing to do.
+
+   Called by the idle thread with interrupts off.  Interrupts are
+   enabled while the page is being zeroed, and are off again on
+   return. */
+bool palloc_zero_idle(void) {
+  struct pool* pool;
+  struct free_block* page;
+  size_t page_idx;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (kernel_pool.zeroed_cnt < ZEROED_MAX)
+    pool = &kernel_pool;
+  else if (user_pool.zeroed_cnt < ZEROED_MAX)
+    pool = &user_pool;
+  else
+    return false;
+
+  page_idx = alloc_pages(pool, 1);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+  page = (struct free_block*)(pool->base + PGSIZE * page_idx);
+
+  intr_enable();
+  memset(page, 0, PGSIZE);
+  intr_disable();
+
+  list_push_front(&pool->zeroed, &page->elem);
+  pool->zeroed_cnt++;
+  return true;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void init_pool(struct pool* p, void* base, size_t page_cnt, const char* name) {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP(bitmap_buf_size(page_cnt), PGSIZE);
+  /* We'll put the pool's used_map and free_order at its base.
+     Calculate the space needed for them and subtract it from
+     the pool's size. */
+  size_t bm_size = bitmap_buf_size(page_cnt);
+  size_t bm_pages = DIV_ROUND_UP(bm_size + page_cnt, PGSIZE);
+  int order;
   if (bm_pages > page_cnt)
     PANIC("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
 
   printf("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
-  lock_init(&p->lock);
-  p->used_map = bitmap_create_in_buf(page_cnt, base, bm_pages * PGSIZE);
+  /* Initialize the pool, with every page allocated, then free
+     them all to build the free lists. */
+  p->used_map = bitmap_create_in_buf(page_cnt, base, bm_size);
+  bitmap_set_all(p->used_map, true);
+  p->free_order = (uint8_t*)base + bm_size;
+  memset(p->free_order, 0, page_cnt);
+  for (order = 0; order <= MAX_ORDER; order++)
+    list_init(&p->free_lists[order]);
+  p->page_cnt = page_cnt;
   p->base = base + bm_pages * PGSIZE;
+  list_init(&p->zeroed);
+  p->zeroed_cnt = 0;
+  free_pages(p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -152,7 +253,98 @@ static void init_pool(struct pool* p, void* base, size_t page_cnt, const char* n
 static bool page_from_pool(const struct pool* pool, void* page) {
   size_t page_no = pg_no(page);
   size_t start_page = pg_no(pool->base);
-  size_t end_page = start_page + bitmap_size(pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the free block header stored in page PAGE_IDX of
+   POOL. */
+static struct free_block* block_at(struct pool* pool, size_t page_idx) {
+  return (struct free_block*)(pool->base + PGSIZE * page_idx);
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first one, or BITMAP_ERROR if no free block is
+   large enough. */
+static size_t alloc_pages(struct pool* pool, size_t page_cnt) {
+  struct free_block* b;
+  size_t page_idx;
+  int order, want;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  /* Find the smallest order that can satisfy the request. */
+  for (want = 0; want <= MAX_ORDER && ((size_t)1 << want) < page_cnt; want++)
+    continue;
+  for (order = want; order <= MAX_ORDER; order++)
+    if (!list_empty(&pool->free_lists[order]))
+      break;
+  if (order > MAX_ORDER)
+    return BITMAP_ERROR;
+
+  b = list_entry(list_pop_front(&pool->free_lists[order]), struct free_block, elem);
+  page_idx = ((uint8_t*)b - pool->base) / PGSIZE;
+  pool->free_order[page_idx] = 0;
+
+  /* Split off the upper halves until the block is just big
+     enough, then give back the pages beyond PAGE_CNT. */
+  while (order > want) {
+    order--;
+    pool->free_order[page_idx + ((size_t)1 << order)] = order + 1;
+    list_push_front(&pool->free_lists[order],
+                    &block_at(pool, page_idx + ((size_t)1 << order))->elem);
+  }
+  bitmap_set_multiple(pool->used_map, page_idx, ((size_t)1 << order), true);
+  free_pages(pool, page_idx + page_cnt, ((size_t)1 << order) - page_cnt);
+
+  return page_idx;
+}
+
+/* Frees the PAGE_CNT pages starting at index PAGE_IDX in POOL,
+   which need not form a single block. */
+static void free_pages(struct pool* pool, size_t page_idx, size_t page_cnt) {
+  ASSERT(page_idx + page_cnt <= pool->page_cnt);
+  ASSERT(bitmap_all(pool->used_map, page_idx, page_cnt));
+  bitmap_set_multiple(pool->used_map, page_idx, page_cnt, false);
+
+  /* Break the range into the largest aligned blocks. */
+  while (page_cnt > 0) {
+    int order = 0;
+    while (order < MAX_ORDER && page_idx % ((size_t)2 << order) == 0
+           && ((size_t)2 << order) <= page_cnt)
+      order++;
+    free_block(pool, page_idx, order);
+    page_idx += (size_t)1 << order;
+    page_cnt -= (size_t)1 << order;
+  }
+}
+
+/* Puts the block of order ORDER starting at index PAGE_IDX in
+   POOL on the free lists, merging it with its buddies. */
+static void free_block(struct pool* pool, size_t page_idx, int order) {
+  while (order < MAX_ORDER) {
+    size_t buddy = page_idx ^ ((size_t)1 << order);
+    if (buddy + ((size_t)1 << order) > pool->page_cnt || pool->free_order[buddy] != order + 1)
+      break;
+    list_remove(&block_at(pool, buddy)->elem);
+    pool->free_order[buddy] = 0;
+    if (buddy < page_idx)
+      page_idx = buddy;
+    order++;
+  }
+
+  pool->free_order[page_idx] = order + 1;
+  list_push_front(&pool->free_lists[order], &block_at(pool, page_idx)->elem);
+}
+
+/* Returns POOL's pre-zeroed pages to its free lists. */
+static void release_zeroed(struct pool* pool) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  while (!list_empty(&pool->zeroed)) {
+    struct free_block* b = list_entry(list_pop_front(&pool->zeroed), struct free_block, elem);
+    free_pages(pool, ((uint8_t*)b - pool->base) / PGSIZE, 1);
+  }
+  pool->zeroed_cnt = 0;
+}
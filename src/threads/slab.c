@@ -0,0 +1,232 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Object caches.
+
+   malloc() rounds every request up to a power of 2, wasting up
+   to half of each block.  Kernel structures that are allocated
+   often instead get a cache of their own, which packs objects of
+   exactly their size into pages called "slabs".
+
+   Each slab starts with a header, followed by as many objects as
+   fit.  Free objects in a slab are kept on a singly linked list
+   threaded through their first word, or, for caches with a
+   constructor, through an extra word after the object so that
+   freed objects stay constructed.  A cache keeps its slabs on
+   two lists, partial and full, and allocates from the partial
+   ones first.  When a slab's last object is freed, it becomes the
+   cache's spare, and the previous spare, if any, is returned to
+   the page allocator. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x5ab1a7e5
+
+/* A slab: one page of objects. */
+struct slab {
+  unsigned magic;           /* Always set to SLAB_MAGIC. */
+  struct slab_cache* cache; /* Owning cache. */
+  struct list_elem elem;    /* Element in cache's partial or full list. */
+  void* free;               /* First free object. */
+  size_t in_use;            /* Number of allocated objects. */
+};
+
+/* All caches, for slab_print_stats(). */
+static struct list all_caches = LIST_INITIALIZER(all_caches);
+
+static struct slab* new_slab(struct slab_cache*);
+static void** free_link(struct slab_cache*, void* obj);
+static struct slab* obj_to_slab(struct slab_cache*, void* obj);
+
+/* Initializes cache C for objects of SIZE bytes, aligned on ALIGN
+   bytes, which must be a power of 2 (or 0 for pointer
+   alignment).  If CTOR is nonnull, it is called to construct each
+   object.  NAME identifies the cache in statistics. */
+void slab_cache_init(struct slab_cache* c, const char* name, size_t size, size_t align,
+                     slab_ctor_func* ctor) {
+  enum intr_level old_level;
+
+  if (align < sizeof(void*))
+    align = sizeof(void*);
+  ASSERT((align & (align - 1)) == 0);
+  if (size < sizeof(void*))
+    size = sizeof(void*);
+
+  c->name = name;
+  c->link_offset = ctor != NULL ? ROUND_UP(size, sizeof(void*)) : 0;
+  c->obj_size = ROUND_UP(ctor != NULL ? c->link_offset + sizeof(void*) : size, align);
+  c->obj_offset = ROUND_UP(sizeof(struct slab), align);
+  ASSERT(c->obj_offset + c->obj_size <= PGSIZE);
+  c->objs_per_slab = (PGSIZE - c->obj_offset) / c->obj_size;
+  c->ctor = ctor;
+  lock_init(&c->lock);
+  list_init(&c->partial);
+  list_init(&c->full);
+  c->empty = NULL;
+  c->slab_cnt = 0;
+  c->obj_cnt = 0;
+
+  old_level = intr_disable();
+  list_push_back(&all_caches, &c->elem);
+  intr_set_level(old_level);
+}
+
+/* Obtains and returns an object from cache C.  Returns a null
+   pointer if memory is not available. */
+void* slab_alloc(struct slab_cache* c) {
+  struct slab* s;
+  void* obj;
+
+  lock_acquire(&c->lock);
+
+  /* Find a slab with a free object, creating one if necessary. */
+  if (!list_empty(&c->partial))
+    s = list_entry(list_front(&c->partial), struct slab, elem);
+  else {
+    if (c->empty != NULL) {
+      s = c->empty;
+      c->empty = NULL;
+    } else {
+      s = new_slab(c);
+      if (s == NULL) {
+        lock_release(&c->lock);
+        return NULL;
+      }
+    }
+    list_push_front(&c->partial, &s->elem);
+  }
+
+  /* Take its first free object. */
+  obj = s->free;
+  s->free = *free_link(c, obj);
+  if (++s->in_use == c->objs_per_slab) {
+    list_remove(&s->elem);
+    list_push_front(&c->full, &s->elem);
+  }
+  c->obj_cnt++;
+
+  lock_release(&c->lock);
+  return obj;
+}
+
+/* Obtains an object from cache C and fills it with zeros.
+   Returns a null pointer if memory is not available.  Only for
+   caches without a constructor. */
+void* slab_zalloc(struct slab_cache* c) {
+  void* obj;
+
+  ASSERT(c->ctor == NULL);
+  obj = slab_alloc(c);
+  if (obj != NULL)
+    memset(obj, 0, c->obj_size);
+  return obj;
+}
+
+/* Returns OBJ, which must have been obtained from cache C, to
+   C.  OBJ may be a null pointer, in which case nothing
+   happens. */
+void slab_free(struct slab_cache* c, void* obj) {
+  struct slab* s;
+  struct slab* spare = NULL;
+
+  if (obj == NULL)
+    return;
+  s = obj_to_slab(c, obj);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs. */
+  if (c->ctor == NULL)
+    memset(obj, 0xcc, c->obj_size);
+#endif
+
+  lock_acquire(&c->lock);
+
+  ASSERT(s->in_use > 0);
+  if (s->in_use-- == c->objs_per_slab) {
+    list_remove(&s->elem);
+    list_push_front(&c->partial, &s->elem);
+  }
+  *free_link(c, obj) = s->free;
+  s->free = obj;
+  c->obj_cnt--;
+
+  /* Keep one empty slab around, so that alternating allocations
+     and frees do not keep going back to the page allocator. */
+  if (s->in_use == 0) {
+    list_remove(&s->elem);
+    spare = c->empty;
+    c->empty = s;
+    if (spare != NULL)
+      c->slab_cnt--;
+  }
+
+  lock_release(&c->lock);
+
+  if (spare != NULL)
+    palloc_free_page(spare);
+}
+
+/* Prints the utilisation of every cache: the fraction of its
+   slab pages occupied by allocated objects. */
+void slab_print_stats(void) {
+  struct list_elem* e;
+
+  for (e = list_begin(&all_caches); e != list_end(&all_caches); e = list_next(e)) {
+    struct slab_cache* c = list_entry(e, struct slab_cache, elem);
+    size_t used = c->obj_cnt * c->obj_size;
+    size_t total = c->slab_cnt * PGSIZE;
+
+    printf("Slab %s: %zu objects of %zu bytes in %zu slabs, %zu%% used\n", c->name,
+           c->obj_cnt, c->obj_size, c->slab_cnt, total != 0 ? used * 100 / total : 0);
+  }
+}
+
+/* Allocates a new slab for cache C, constructing its objects.
+   Returns a null pointer if memory is not available. */
+static struct slab* new_slab(struct slab_cache* c) {
+  struct slab* s = palloc_get_page(0);
+  size_t i;
+
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->in_use = 0;
+  s->free = NULL;
+  for (i = c->objs_per_slab; i-- > 0;) {
+    void* obj = (uint8_t*)s + c->obj_offset + i * c->obj_size;
+    if (c->ctor != NULL)
+      c->ctor(obj);
+    *free_link(c, obj) = s->free;
+    s->free = obj;
+  }
+  c->slab_cnt++;
+  return s;
+}
+
+/* Returns the slab that OBJ, an object of cache C, is inside. */
+static struct slab* obj_to_slab(struct slab_cache* c, void* obj) {
+  struct slab* s = pg_round_down(obj);
+
+  /* Check that the slab is valid. */
+  ASSERT(s->magic == SLAB_MAGIC);
+  ASSERT(s->cache == c);
+
+  /* Check that the object is properly aligned for the slab. */
+  ASSERT(pg_ofs(obj) >= c->obj_offset);
+  ASSERT((pg_ofs(obj) - c->obj_offset) % c->obj_size == 0);
+
+  return s;
+}
+
+/* Returns the free list link of OBJ, an object of cache C. */
+static void** free_link(struct slab_cache* c, void* obj) {
+  return (void**)((uint8_t*)obj + c->link_offset);
+}
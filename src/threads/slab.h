@@ -0,0 +1,36 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Object constructor.  Called once for each object when its slab
+   is created; objects must be freed in the constructed state. */
+typedef void slab_ctor_func(void* obj);
+
+/* A cache of equally sized objects.  Treat as opaque. */
+struct slab_cache {
+  const char* name;       /* Name, for statistics. */
+  size_t obj_size;        /* Size of each object slot, rounded up to alignment. */
+  size_t link_offset;     /* Offset of free list link in a free object. */
+  size_t obj_offset;      /* Offset of first object in a slab. */
+  size_t objs_per_slab;   /* Number of objects in a slab. */
+  slab_ctor_func* ctor;   /* Constructor, or null. */
+  struct lock lock;       /* Protects everything below. */
+  struct list partial;    /* Slabs with free and allocated objects. */
+  struct list full;       /* Slabs with no free objects. */
+  struct slab* empty;     /* Spare slab with no allocated objects, or null. */
+  size_t slab_cnt;        /* Number of slabs, including the spare. */
+  size_t obj_cnt;         /* Number of allocated objects. */
+  struct list_elem elem;  /* Element in list of all caches. */
+};
+
+void slab_cache_init(struct slab_cache*, const char* name, size_t size, size_t align,
+                     slab_ctor_func*);
+void* slab_alloc(struct slab_cache*);
+void* slab_zalloc(struct slab_cache*);
+void slab_free(struct slab_cache*, void*);
+void slab_print_stats(void);
+
+#endif /* threads/slab.h */
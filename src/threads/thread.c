@@ -11,6 +11,7 @@
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -24,6 +25,13 @@
    that are ready to run but not actually running. */
 static struct list fifo_ready_list;
 
+/* Lists of processes in THREAD_READY state for the strict-priority
+   scheduler, one per priority level.  Bit P of prio_ready_bitmap
+   is set if and only if prio_ready_lists[P] is nonempty, so the
+   highest-priority ready thread can be found without scanning. */
+static struct list prio_ready_lists[PRI_MAX + 1];
+static uint64_t prio_ready_bitmap;
+
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
@@ -70,6 +78,7 @@ static struct thread* thread_schedule_prio(void);
 static struct thread* thread_schedule_fair(void);
 static struct thread* thread_schedule_mlfqs(void);
 static struct thread* thread_schedule_reserved(void);
+static int prio_ready_max(void);
 
 /* Determines which scheduler the kernel should use.
    Controlled by the kernel command-line options
@@ -107,6 +116,9 @@ void thread_init(void) {
 
   lock_init(&tid_lock);
   list_init(&fifo_ready_list);
+  for (int i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init(&prio_ready_lists[i]);
+  prio_ready_bitmap = 0;
   list_init(&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -114,6 +126,8 @@ void thread_init(void) {
   init_thread(initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid();
+
+  fpu_init();
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -151,6 +165,15 @@ void thread_tick(void) {
     intr_yield_on_return();
 }
 
+/* Accounts for CNT timer ticks that were suppressed while the
+   CPU idled in tickless mode (see timer_tickless_enter()).  Like
+   thread_tick(), runs in an external interrupt context or with
+   interrupts off. */
+void thread_tick_idle(int64_t cnt) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  idle_ticks += cnt;
+}
+
 /* Prints thread statistics. */
 void thread_print_stats(void) {
   printf("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n", idle_ticks, kernel_ticks,
@@ -169,9 +192,8 @@ void thread_print_stats(void) {
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   Under the strict-priority scheduler, the running thread yields
+   immediately if the new thread has a higher priority. */
 tid_t thread_create(const char* name, int priority, thread_func* function, void* aux) {
   struct thread* t;
   struct kernel_thread_frame* kf;
@@ -207,6 +229,10 @@ tid_t thread_create(const char* name, int priority, thread_func* function, void*
   /* Add to run queue. */
   thread_unblock(t);
 
+  /* Let the new thread run now if it outranks us. */
+  if (active_sched_policy == SCHED_PRIO && priority > thread_current()->priority)
+    thread_yield();
+
   return tid;
 }
 
@@ -224,6 +250,16 @@ void thread_block(void) {
   schedule();
 }
 
+/* Returns true if any thread is waiting on the ready structure.
+   Must be called with interrupts off. */
+bool threads_ready(void) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (active_sched_policy == SCHED_PRIO)
+    return prio_ready_bitmap != 0;
+  return !list_empty(&fifo_ready_list);
+}
+
 /* Places a thread on the ready structure appropriate for the
    current active scheduling policy.
    
@@ -234,7 +270,10 @@ static void thread_enqueue(struct thread* t) {
 
   if (active_sched_policy == SCHED_FIFO)
     list_push_back(&fifo_ready_list, &t->elem);
-  else
+  else if (active_sched_policy == SCHED_PRIO) {
+    list_push_back(&prio_ready_lists[t->priority], &t->elem);
+    prio_ready_bitmap |= (uint64_t)1 << t->priority;
+  } else
     PANIC("Unimplemented scheduling policy value: %d", active_sched_policy);
 }
 
@@ -286,6 +325,8 @@ tid_t thread_tid(void) { return thread_current()->tid; }
 void thread_exit(void) {
   ASSERT(!intr_context());
 
+  fpu_exit();
+
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_switch_tail(). */
@@ -325,8 +366,23 @@ void thread_foreach(thread_action_func* func, void* aux) {
   }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
-void thread_set_priority(int new_priority) { thread_current()->priority = new_priority; }
+/* Sets the current thread's priority to NEW_PRIORITY.
+   Under the strict-priority scheduler, yields if some ready
+   thread now has a higher priority. */
+void thread_set_priority(int new_priority) {
+  enum intr_level old_level;
+  bool outranked;
+
+  ASSERT(PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  old_level = intr_disable();
+  thread_current()->priority = new_priority;
+  outranked = active_sched_policy == SCHED_PRIO && prio_ready_max() > new_priority;
+  intr_set_level(old_level);
+
+  if (outranked)
+    thread_yield();
+}
 
 /* Returns the current thread's priority. */
 int thread_get_priority(void) { return thread_current()->priority; }
@@ -372,6 +428,17 @@ static void idle(void* idle_started_ UNUSED) {
     intr_disable();
     thread_block();
 
+    /* Until another thread becomes ready, zero pages for later
+       PAL_ZERO allocations. */
+    while (!threads_ready() && palloc_zero_idle())
+      continue;
+
+    /* Zeroing runs with interrupts on, so an interrupt may have
+       readied a thread meanwhile.  Run it now rather than after
+       the next interrupt. */
+    if (threads_ready())
+      continue;
+
     /* Re-enable interrupts and wait for the next one.
 
          Originally:
@@ -389,9 +456,15 @@ static void idle(void* idle_started_ UNUSED) {
          7.11.1 "HLT Instruction".
          
          To keep it consistent with x86 Pintos, we handled this
-         case in intr_handler. */
+         case in intr_handler.
+
+         With -tickless, the periodic tick is stopped for as long
+         as nothing can become ready, and restarted on wake-up. */
+    timer_tickless_enter();
     csr_write(CSR_SSTATUS, csr_read(CSR_SSTATUS) | SSTATUS_SIE);
     wfi();
+    intr_disable();
+    timer_tickless_exit();
   }
 }
 
@@ -463,9 +536,64 @@ static struct thread* thread_schedule_fifo(void) {
     return idle_thread;
 }
 
-/* Strict priority scheduler */
+/* Returns the highest priority that has a ready thread, or
+   PRI_MIN - 1 if no thread is ready.  Takes constant time: a
+   binary search for the most significant set bit of
+   prio_ready_bitmap.  (We avoid __builtin_clz() because the
+   kernel is not linked against libgcc.) */
+static int prio_ready_max(void) {
+  uint32_t word;
+  int pri;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (prio_ready_bitmap == 0)
+    return PRI_MIN - 1;
+
+  word = prio_ready_bitmap >> 32;
+  pri = 32;
+  if (word == 0) {
+    word = (uint32_t)prio_ready_bitmap;
+    pri = 0;
+  }
+  if (word & 0xffff0000) {
+    pri += 16;
+    word >>= 16;
+  }
+  if (word & 0xff00) {
+    pri += 8;
+    word >>= 8;
+  }
+  if (word & 0xf0) {
+    pri += 4;
+    word >>= 4;
+  }
+  if (word & 0xc) {
+    pri += 2;
+    word >>= 2;
+  }
+  if (word & 0x2)
+    pri += 1;
+  return pri;
+}
+
+/* Strict priority scheduler.  Picks the front of the
+   highest-priority nonempty ready list; threads of equal
+   priority are served round-robin because thread_enqueue()
+   appends to the back. */
 static struct thread* thread_schedule_prio(void) {
-  PANIC("Unimplemented scheduler policy: \"-sched=prio\"");
+  int pri = prio_ready_max();
+  struct list* ready_list;
+  struct thread* t;
+
+  if (pri < PRI_MIN)
+    return idle_thread;
+
+  ready_list = &prio_ready_lists[pri];
+  t = list_entry(list_pop_front(ready_list), struct thread, elem);
+  if (list_empty(ready_list))
+    prio_ready_bitmap &= ~((uint64_t)1 << pri);
+  return t;
 }
 
 /* Fair priority scheduler */
@@ -525,6 +653,9 @@ void thread_switch_tail(struct thread* prev) {
   process_activate();
 #endif
 
+  /* Disable the FPU unless the new thread owns it. */
+  fpu_switch();
+
   /* If the thread we switched from is dying, destroy its struct
      thread.  This must happen late so that thread_exit() doesn't
      pull out the rug under itself.  (We don't free
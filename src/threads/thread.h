@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include "threads/synch.h"
 #include "threads/fixed-point.h"
+#include "threads/fpu.h"
 
 /* States in a thread's life cycle. */
 enum thread_status {
@@ -80,7 +81,9 @@ typedef int tid_t;
    semaphore wait list (synch.c).  It can be used these two ways
    only because they are mutually exclusive: only a thread in the
    ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+   blocked state is on a semaphore wait list.  A thread blocked in
+   timer_sleep() uses it for the sleep queue (timer.c) in the
+   same way. */
 struct thread {
   /* Owned by thread.c. */
   tid_t tid;                 /* Thread identifier. */
@@ -90,14 +93,26 @@ struct thread {
   int priority;              /* Priority. */
   struct list_elem allelem;  /* List element for all threads list. */
 
-  /* Shared between thread.c and synch.c. */
+  /* Shared between thread.c, synch.c, and timer.c. */
   struct list_elem elem; /* List element. */
 
+  /* Owned by timer.c. */
+  int64_t wakeup_tick; /* Tick at which a sleeping thread wakes. */
+
+  /* Owned by fpu.c. */
+  struct fpu_context* fpu[FPU_LEVEL_CNT]; /* Saved FP registers, or null if never used. */
+
 #ifdef USERPROG
   /* Owned by process.c. */
   struct process* pcb; /* Process control block if this thread is a userprog */
 #endif
 
+#ifdef FILESYS
+  /* Owned by filesys/journal.c. */
+  int journal_depth;   /* Nesting depth of journal handles. */
+  int journal_credits; /* Sectors the handle may still add. */
+#endif
+
   /* Owned by thread.c. */
   unsigned magic; /* Detects stack overflow. */
 };
@@ -122,6 +137,7 @@ void thread_init(void);
 void thread_start(void);
 
 void thread_tick(void);
+void thread_tick_idle(int64_t cnt);
 void thread_print_stats(void);
 
 typedef void thread_func(void* aux);
@@ -129,6 +145,7 @@ tid_t thread_create(const char* name, int priority, thread_func*, void*);
 
 void thread_block(void);
 void thread_unblock(struct thread*);
+bool threads_ready(void);
 
 struct thread* thread_current(void);
 tid_t thread_tid(void);
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <riscv.h>
 #include "userprog/process.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
@@ -12,6 +13,7 @@ static long long page_fault_cnt;
 
 static void kill(struct intr_frame*);
 static void page_fault(struct intr_frame*);
+static void illegal_instruction(struct intr_frame*);
 
 /* Registers handlers for interrupts that can be caused by user
    programs.
@@ -36,7 +38,7 @@ void exception_init(void) {
      e.g. #DE can be caused by dividing by 0. */
   intr_register_int(EXC_INSTRUCTION_MISALIGNED, true, INTR_ON, kill, "#IM Instruction Address Misaligned");;
   intr_register_int(EXC_INSTRUCTION_FAULT, true, INTR_ON, kill, "#IF Instruction Access Fault");;
-  intr_register_int(EXC_ILLEGAL_INSTRUCTION, true, INTR_ON, kill, "#IL Illegal Instruction");;
+  intr_register_int(EXC_ILLEGAL_INSTRUCTION, true, INTR_ON, illegal_instruction, "#IL Illegal Instruction");;
   intr_register_int(EXC_LOAD_MISALIGNED, true, INTR_ON, kill, "#LM Load Address Misaligned");;
   intr_register_int(EXC_LOAD_FAULT, true, INTR_ON, kill, "#LF Load Access Fault");;
   intr_register_int(EXC_STORE_MISALIGNED, true, INTR_ON, kill, "#SM Store/AMO Address Misaligned");;
@@ -86,6 +88,14 @@ static void kill(struct intr_frame* f) {
     }
 }
 
+/* Illegal instruction handler.  The first FP instruction of a
+   context that does not own the FPU lands here; anything else
+   kills the offender. */
+static void illegal_instruction(struct intr_frame* f) {
+  if (!fpu_handle_trap(f))
+    kill(f);
+}
+
 /* Page fault handler.  This is a skeleton that must be filled in
    to implement virtual memory.  Some solutions to project 2 may
    also require modifying this code.
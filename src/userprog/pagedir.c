@@ -4,10 +4,32 @@
 #include <string.h>
 #include <riscv.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 
-static void invalidate_pagedir(uint_t*);
+static void invalidate_page(uint_t*, const void*);
+static int cached_asid(uint_t*);
+static unsigned asid_get(uint_t*, asid_t*, bool* flush);
+
+/* Address space identifiers (ASIDs).
+
+   Each process's page directory is tagged with an ASID in SATP,
+   so that switching between processes does not have to discard
+   the TLB: translations cached for other ASIDs simply stop
+   matching.  ASID 0 belongs to init_page_dir.
+
+   ASIDs are handed out in generations.  When they run out, a new
+   generation starts: the whole TLB is flushed once, and every
+   process is assigned a fresh ASID the next time it is
+   activated.  These variables are only accessed with interrupts
+   off. */
+#define ASID_LIMIT ((SATP_ASID >> SATP_ASID_SHIFT) + 1) /* Architectural maximum. */
+static uint32_t asid_used[ASID_LIMIT / 32];             /* ASIDs in use this generation. */
+static uint_t* asid_owner[ASID_LIMIT];                  /* Page directory using each ASID. */
+static unsigned asid_cnt;        /* ASIDs implemented by the CPU, 0 if not probed yet. */
+static unsigned asid_next;       /* Where to start looking for a free ASID. */
+static asid_t asid_generation;   /* Current generation, a multiple of ASID_LIMIT. */
 
 /* After PHYS_BASE, we set MMIO_START as the base for MMIO.
    Because we have allocated the first two pages for serial and shutdown,
@@ -108,7 +130,7 @@ bool __pagedir_set_page(uint_t* pd, void* vaddr, void* paddr, uint_t rwx, bool g
       *pte = pte_create_user(paddr, rwx);
     else
       *pte = pte_create_general(paddr, rwx);
-    sfence_vma();
+    invalidate_page(pd, vaddr);
     return true;
   } else
     return false;
@@ -174,7 +196,7 @@ void pagedir_clear_page(uint_t* pd, void* upage) {
   pte = lookup_page(pd, upage, false);
   if (pte != NULL && (*pte & PTE_V) != 0) {
     *pte &= ~PTE_V;
-    invalidate_pagedir(pd);
+    invalidate_page(pd, upage);
   }
 }
 
@@ -196,7 +218,7 @@ void pagedir_set_dirty(uint_t* pd, const void* vpage, bool dirty) {
       *pte |= PTE_D;
     else {
       *pte &= ~(uint_t)PTE_D;
-      invalidate_pagedir(pd);
+      invalidate_page(pd, vpage);
     }
   }
 }
@@ -219,34 +241,125 @@ void pagedir_set_accessed(uint_t* pd, const void* vpage, bool accessed) {
       *pte |= PTE_A;
     else {
       *pte &= ~(uint_t)PTE_A;
-      invalidate_pagedir(pd);
+      invalidate_page(pd, vpage);
     }
   }
 }
 
 /* Loads page directory PD into the CPU's page directory base
-   register. */
-void pagedir_activate(uint_t* pd) {
-  if (pd == NULL)
+   register, tagged with the address space identifier in *ASID,
+   which is assigned first if necessary.  If PD is a null
+   pointer, loads init_page_dir instead, and ASID is ignored. */
+void pagedir_activate(uint_t* pd, asid_t* asid) {
+  enum intr_level old_level = intr_disable();
+  unsigned asid_no = 0;
+  bool flush = true;
+
+  if (pd == NULL) {
+    /* init_page_dir has ASID 0 to itself, and its mappings do
+       not change once processes run, so switching to it only
+       has to flush if the CPU has no other ASIDs and processes
+       share ASID 0 with it. */
     pd = init_page_dir;
+    flush = asid_cnt == 1;
+  } else if (asid != NULL)
+    asid_no = asid_get(pd, asid, &flush);
+
+  /* Translations cached under ASID_NO are still valid, unless it
+     has just been recycled, so only flush if we have to.
 
-  /* The SFENCE.VMA is used to flush any local hardware caches related to 
+     The SFENCE.VMA is used to flush any local hardware caches related to 
      address translation.  It is specified as a fence rather than a TLB flush
      to provide cleaner semantics with respect to which instructions are 
      affected by the flush operation and to support a wider variety of dynamic
      caching structures and memory-management schemes.  SFENCE.VMA is also
      used by higher privilege levels to synchronize page table writes and 
      the address translation hardware. */
-  sfence_vma();
+  if (flush)
+    sfence_vma();
 
   /* Store the physical address of the page directory into SATP.  
      This activates our new page tables immediately.
      See [riscv-priviledged-20211203] 4.1.11 "Supervisor Address Translation
      and Protection (satp) Register". */
-  csr_write(CSR_SATP, (pg_no((vtop(pd))) & SATP_PPN) | SATP_SV);
+  csr_write(CSR_SATP, (pg_no((vtop(pd))) & SATP_PPN)
+                      | ((uintptr_t)asid_no << SATP_ASID_SHIFT) | SATP_SV);
 
   /* Make sure we the new page table takes into effect. */
-  sfence_vma();
+  if (flush)
+    sfence_vma();
+
+  intr_set_level(old_level);
+}
+
+/* Gives up the address space identifier in *ASID, whose page
+   directory must not be active, flushing any translations still
+   cached under it. */
+void pagedir_release_asid(asid_t* asid) {
+  enum intr_level old_level = intr_disable();
+
+  if (*asid >= asid_generation && *asid < asid_generation + ASID_LIMIT) {
+    unsigned asid_no = *asid & (ASID_LIMIT - 1);
+    ASSERT(((csr_read(CSR_SATP) & SATP_ASID) >> SATP_ASID_SHIFT) != asid_no);
+    asid_used[asid_no / 32] &= ~(1u << asid_no % 32);
+    asid_owner[asid_no] = NULL;
+    sfence_vma_asid(asid_no);
+  }
+  *asid = 0;
+
+  intr_set_level(old_level);
+}
+
+/* Returns the ASID to tag page directory PD with, given its
+   address space identifier in *ASID.  If *ASID is not from the
+   current generation, assigns a new one, starting a new
+   generation if necessary.  Sets *FLUSH to true if the TLB must
+   be flushed before the ASID can be used, false otherwise. */
+static unsigned asid_get(uint_t* pd, asid_t* asid, bool* flush) {
+  unsigned i;
+
+  /* Find out how many ASIDs the CPU implements by writing all
+     ones to the ASID field and reading back what sticks.  See
+     [riscv-priviledged-20211203] 4.1.11. */
+  if (asid_cnt == 0) {
+    uintptr_t satp = csr_read(CSR_SATP);
+    csr_write(CSR_SATP, satp | SATP_ASID);
+    asid_cnt = ((csr_read(CSR_SATP) & SATP_ASID) >> SATP_ASID_SHIFT) + 1;
+    csr_write(CSR_SATP, satp);
+    sfence_vma();
+    asid_next = 1;
+    asid_generation = ASID_LIMIT;
+  }
+
+  /* Without ASIDs, every switch has to flush. */
+  *flush = asid_cnt == 1;
+  if (*flush)
+    return 0;
+
+  if (*asid >= asid_generation && *asid < asid_generation + ASID_LIMIT)
+    return *asid & (ASID_LIMIT - 1);
+
+  for (i = 0; i < asid_cnt - 1; i++) {
+    unsigned asid_no = asid_next;
+    asid_next = asid_next + 1 < asid_cnt ? asid_next + 1 : 1;
+    if (!(asid_used[asid_no / 32] & (1u << asid_no % 32))) {
+      asid_used[asid_no / 32] |= 1u << asid_no % 32;
+      asid_owner[asid_no] = pd;
+      *asid = asid_generation + asid_no;
+      return asid_no;
+    }
+  }
+
+  /* Out of ASIDs: start a new generation. */
+  memset(asid_used, 0, sizeof asid_used);
+  memset(asid_owner, 0, sizeof asid_owner);
+  asid_generation += ASID_LIMIT;
+  asid_used[0] |= 1u << 1;
+  asid_owner[1] = pd;
+  asid_next = 2 < asid_cnt ? 2 : 1;
+  *asid = asid_generation + 1;
+  *flush = true;
+  return 1;
 }
 
 /* Returns the currently active page directory. */
@@ -265,11 +378,39 @@ uint_t* active_pd(void) {
    table.  When this happens, we have to "invalidate" the TLB by
    re-activating it.
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
-static void invalidate_pagedir(uint_t* pd) {
-  if (active_pd() == pd) {
-    sfence_vma();
+   This function invalidates the TLB entries cached for virtual
+   page VADDR in PD.  Kernel mappings are shared by all page
+   directories, so they are flushed from every address space. */
+static void invalidate_page(uint_t* pd, const void* vaddr) {
+  enum intr_level old_level;
+  int asid_no;
+
+  if (pd == init_page_dir || !is_user_vaddr(vaddr)) {
+    sfence_vma_addr(vaddr);
+    return;
   }
+
+  old_level = intr_disable();
+  asid_no = cached_asid(pd);
+  if (asid_no >= 0)
+    sfence_vma_addr_asid(vaddr, asid_no);
+  intr_set_level(old_level);
+}
+
+/* Returns the ASID under which translations for PD may be cached,
+   or -1 if there can be none.  Must be called with interrupts
+   off. */
+static int cached_asid(uint_t* pd) {
+  unsigned i;
+
+  if (active_pd() == pd)
+    return (csr_read(CSR_SATP) & SATP_ASID) >> SATP_ASID_SHIFT;
+
+  /* Without ASIDs, switching page directories flushes the TLB.
+     Otherwise, a page directory that does not own an ASID in the
+     current generation has had its entries flushed. */
+  for (i = 1; i < asid_cnt; i++)
+    if (asid_owner[i] == pd)
+      return i;
+  return -1;
 }
@@ -6,25 +6,40 @@
 #include <stddef.h>
 
 #define SATP32_MODE 0x80000000
+#define SATP32_ASID 0x7FC00000
 #define SATP32_PPN  0x003FFFFF
 #define SATP64_MODE 0xF000000000000000
+#define SATP64_ASID 0x0FFFF00000000000
 #define SATP64_PPN  0x00000FFFFFFFFFFF
 
+#define SATP32_ASID_SHIFT 22
+#define SATP64_ASID_SHIFT 44
+
 #define SATP_MODE_SV32 1 << 31
 #define SATP_MODE_SV39 8 << 60
 
 #if __riscv_xlen == 32
 #define SATP_MODE SATP32_MODE
+#define SATP_ASID SATP32_ASID
+#define SATP_ASID_SHIFT SATP32_ASID_SHIFT
 #define SATP_PPN SATP32_PPN
 #define SATP_SV SATP_MODE_SV32
 #else
 #define SATP_MODE SATP64_MODE
+#define SATP_ASID SATP64_ASID
+#define SATP_ASID_SHIFT SATP64_ASID_SHIFT
 #define SATP_PPN SATP64_PPN
 #define SATP_SV SATP_MODE_SV39
 #endif /* __riscv_xlen */
 
 #define MMIO_START 0xf0000000L
 
+/* Address space identifier of a page directory, as assigned by
+   pagedir_activate().  The low bits are the ASID written to
+   SATP, the high bits the generation it was allocated in.  Zero
+   means that none has been assigned yet. */
+typedef uint64_t asid_t;
+
 uint_t* pagedir_create(void);
 void pagedir_destroy(uint_t* pd);
 bool pagedir_set_page(uint_t* pd, void* upage, void* kpage, uint_t rwx);
@@ -34,7 +49,8 @@ bool pagedir_is_dirty(uint_t* pd, const void* upage);
 void pagedir_set_dirty(uint_t* pd, const void* upage, bool dirty);
 bool pagedir_is_accessed(uint_t* pd, const void* upage);
 void pagedir_set_accessed(uint_t* pd, const void* upage, bool accessed);
-void pagedir_activate(uint_t* pd);
+void pagedir_activate(uint_t* pd, asid_t* asid);
+void pagedir_release_asid(asid_t* asid);
 uint_t* active_pd(void);
 
 #ifdef MACHINE
@@ -14,6 +14,7 @@
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
@@ -21,6 +22,7 @@
 #include "threads/pte.h"
 
 static struct semaphore temporary;
+static struct slab_cache process_cache;
 static thread_func start_process NO_RETURN;
 static thread_func start_pthread NO_RETURN;
 static bool load(const char* file_name, struct intr_frame*);
@@ -35,11 +37,12 @@ void userprog_init(void) {
   bool success;
 
   /* Allocate process control block
-     It is imoprtant that this is a call to calloc and not malloc,
+     It is imoprtant that the PCB is zeroed,
      so that t->pcb->pagedir is guaranteed to be NULL (the kernel's
      page directory) when t->pcb is assigned, because a timer interrupt
      can come at any time and activate our pagedir */
-  t->pcb = calloc(sizeof(struct process), 1);
+  slab_cache_init(&process_cache, "process", sizeof(struct process), 0, NULL);
+  t->pcb = slab_zalloc(&process_cache);
   success = t->pcb != NULL;
 
   /* Kill the kernel if we did not succeed */
@@ -78,7 +81,7 @@ static void start_process(void* file_name_) {
   bool success, pcb_success;
 
   /* Allocate process control block */
-  struct process* new_pcb = malloc(sizeof(struct process));
+  struct process* new_pcb = slab_alloc(&process_cache);
   success = pcb_success = new_pcb != NULL;
 
   /* Initialize process control block */
@@ -86,6 +89,7 @@ static void start_process(void* file_name_) {
     // Ensure that timer_interrupt() -> schedule() -> process_activate()
     // does not try to activate our uninitialized pagedir
     new_pcb->pagedir = NULL;
+    new_pcb->asid = 0;
     t->pcb = new_pcb;
 
     // Continue initializing the PCB as normal
@@ -101,7 +105,7 @@ static void start_process(void* file_name_) {
        when entering intr_exit.
        If the SUM bit in the sstatus register is set, supervisor mode
        software may also access pages with U=1. So we also set SUM. */ 
-    if_.status = (csr_read(CSR_SSTATUS) & ~SSTATUS_SPP & ~SSTATUS_SIE)
+    if_.status = (csr_read(CSR_SSTATUS) & ~SSTATUS_SPP & ~SSTATUS_SIE & ~SSTATUS_FS)
                   | SSTATUS_SPIE | SSTATUS_SUM;
 
     success = load(file_name, &if_);
@@ -114,7 +118,9 @@ static void start_process(void* file_name_) {
     // can try to activate the pagedir, but it is now freed memory
     struct process* pcb_to_free = t->pcb;
     t->pcb = NULL;
-    free(pcb_to_free);
+    process_activate();
+    pagedir_release_asid(&pcb_to_free->asid);
+    slab_free(&process_cache, pcb_to_free);
   }
 
   /* Clean up. Exit on failure or jump to userspace */
@@ -174,8 +180,9 @@ void process_exit(void) {
          directory, or our active page directory will be one
          that's been freed (and cleared). */
     cur->pcb->pagedir = NULL;
-    pagedir_activate(NULL);
+    pagedir_activate(NULL, NULL);
     pagedir_destroy(pd);
+    pagedir_release_asid(&cur->pcb->asid);
   }
 
   /* Free the PCB of this process and kill this thread
@@ -184,7 +191,7 @@ void process_exit(void) {
      can try to activate the pagedir, but it is now freed memory */
   struct process* pcb_to_free = cur->pcb;
   cur->pcb = NULL;
-  free(pcb_to_free);
+  slab_free(&process_cache, pcb_to_free);
 
   sema_up(&temporary);
   thread_exit();
@@ -197,9 +204,9 @@ void process_activate(void) {
 
   /* Activate thread's page tables. */
   if (t->pcb != NULL && t->pcb->pagedir != NULL)
-    pagedir_activate(t->pcb->pagedir);
+    pagedir_activate(t->pcb->pagedir, &t->pcb->asid);
   else
-    pagedir_activate(NULL);
+    pagedir_activate(NULL, NULL);
 }
 
 /* We load ELF binaries.  The following definitions are taken
@@ -2,6 +2,7 @@
 #define USERPROG_PROCESS_H
 
 #include "threads/thread.h"
+#include "userprog/pagedir.h"
 #include <stdint.h>
 
 // At most 8MB can be allocated to the stack
@@ -25,6 +26,7 @@ typedef void (*stub_fun)(pthread_fun, void*);
 struct process {
   /* Owned by process.c. */
   uint32_t* pagedir;          /* Page directory. */
+  asid_t asid;                /* Address space identifier of pagedir. */
   char process_name[16];      /* Name of the main thread */
   struct thread* main_thread; /* Pointer to main thread */
 };